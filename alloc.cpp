@@ -0,0 +1,42 @@
+#include "alloc.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+static atomic<uint64_t> allocations(0);
+
+uint64_t allocation_count() {
+    return allocations;
+}
+
+#if ALLOC_CHECK
+void* operator new(size_t size) {
+    ++allocations;
+    if(void *p = malloc(size ? size : 1))
+        return p;
+    throw bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+    free(p);
+}
+#endif
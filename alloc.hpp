@@ -0,0 +1,15 @@
+#ifndef ALLOC_HPP_
+#define ALLOC_HPP_
+
+#include <cstdint>
+
+// make ALLOC_CHECK=1 replaces the global operator new with one counting its
+// calls, to check that the search does not allocate.
+#ifndef ALLOC_CHECK
+#define ALLOC_CHECK 0
+#endif
+
+// operator new calls of every thread so far (always 0 without ALLOC_CHECK)
+uint64_t allocation_count();
+
+#endif
@@ -0,0 +1,173 @@
+#include "attacks.hpp"
+
+#include <immintrin.h>
+
+#include "magicmoves.hpp"
+
+using namespace std;
+
+const Bitboard NOT_FILE_A = 0xFEFEFEFEFEFEFEFEULL;
+const Bitboard NOT_FILE_H = 0x7F7F7F7F7F7F7F7FULL;
+const Bitboard NOT_FILE_AB = 0xFCFCFCFCFCFCFCFCULL;
+const Bitboard NOT_FILE_GH = 0x3F3F3F3F3F3F3F3FULL;
+
+/* Lane i fills towards higher squares by SHIFTS[i] and towards lower
+    squares by the same amount: north/south, east/west, north-east/south-west
+    and north-west/south-east. The masks drop the squares which wrapped
+    around the board. */
+alignas(32) const uint64_t SHIFTS[4] = {8, 1, 9, 7};
+alignas(32) const Bitboard UP_MASKS[4] = {~0ULL, NOT_FILE_A, NOT_FILE_A, NOT_FILE_H};
+alignas(32) const Bitboard DOWN_MASKS[4] = {~0ULL, NOT_FILE_H, NOT_FILE_H, NOT_FILE_A};
+
+const int NB_GEN = 16;
+
+typedef void (*SlideKernel)(const Bitboard*, Bitboard, Bitboard*);
+
+// attacks of the sliders gen[i] along the two directions of lane i % 4
+static void slide_scalar(const Bitboard *gen, Bitboard empty, Bitboard *out) {
+    // the propagators only depend on the occupancy
+    Bitboard up_pro[4][3], down_pro[4][3];
+    for(int d = 0; d < 4; ++d) {
+        int s = SHIFTS[d];
+        up_pro[d][0] = empty & UP_MASKS[d];
+        up_pro[d][1] = up_pro[d][0] & (up_pro[d][0] << s);
+        up_pro[d][2] = up_pro[d][1] & (up_pro[d][1] << 2*s);
+        down_pro[d][0] = empty & DOWN_MASKS[d];
+        down_pro[d][1] = down_pro[d][0] & (down_pro[d][0] >> s);
+        down_pro[d][2] = down_pro[d][1] & (down_pro[d][1] >> 2*s);
+    }
+    for(int i = 0; i < NB_GEN; ++i) {
+        int d = i % 4, s = SHIFTS[d];
+        Bitboard g = gen[i];
+        g |= up_pro[d][0] & (g << s);
+        g |= up_pro[d][1] & (g << 2*s);
+        g |= up_pro[d][2] & (g << 4*s);
+        Bitboard up = (g << s) & UP_MASKS[d];
+        g = gen[i];
+        g |= down_pro[d][0] & (g >> s);
+        g |= down_pro[d][1] & (g >> 2*s);
+        g |= down_pro[d][2] & (g >> 4*s);
+        out[i] = up | ((g >> s) & DOWN_MASKS[d]);
+    }
+}
+
+__attribute__((target("avx2")))
+static void slide_avx2(const Bitboard *gen, Bitboard empty, Bitboard *out) {
+    const __m256i s1 = _mm256_load_si256((const __m256i*)SHIFTS);
+    const __m256i s2 = _mm256_add_epi64(s1, s1);
+    const __m256i s4 = _mm256_add_epi64(s2, s2);
+    const __m256i up_mask = _mm256_load_si256((const __m256i*)UP_MASKS);
+    const __m256i down_mask = _mm256_load_si256((const __m256i*)DOWN_MASKS);
+    const __m256i e = _mm256_set1_epi64x(empty);
+    const __m256i up_pro0 = _mm256_and_si256(e, up_mask);
+    const __m256i up_pro1 = _mm256_and_si256(up_pro0, _mm256_sllv_epi64(up_pro0, s1));
+    const __m256i up_pro2 = _mm256_and_si256(up_pro1, _mm256_sllv_epi64(up_pro1, s2));
+    const __m256i down_pro0 = _mm256_and_si256(e, down_mask);
+    const __m256i down_pro1 = _mm256_and_si256(down_pro0, _mm256_srlv_epi64(down_pro0, s1));
+    const __m256i down_pro2 = _mm256_and_si256(down_pro1, _mm256_srlv_epi64(down_pro1, s2));
+    for(int v = 0; v < NB_GEN/4; ++v) {
+        const __m256i g0 = _mm256_load_si256((const __m256i*)gen + v);
+        __m256i g = g0;
+        g = _mm256_or_si256(g, _mm256_and_si256(up_pro0, _mm256_sllv_epi64(g, s1)));
+        g = _mm256_or_si256(g, _mm256_and_si256(up_pro1, _mm256_sllv_epi64(g, s2)));
+        g = _mm256_or_si256(g, _mm256_and_si256(up_pro2, _mm256_sllv_epi64(g, s4)));
+        __m256i up = _mm256_and_si256(_mm256_sllv_epi64(g, s1), up_mask);
+        g = g0;
+        g = _mm256_or_si256(g, _mm256_and_si256(down_pro0, _mm256_srlv_epi64(g, s1)));
+        g = _mm256_or_si256(g, _mm256_and_si256(down_pro1, _mm256_srlv_epi64(g, s2)));
+        g = _mm256_or_si256(g, _mm256_and_si256(down_pro2, _mm256_srlv_epi64(g, s4)));
+        __m256i down = _mm256_and_si256(_mm256_srlv_epi64(g, s1), down_mask);
+        _mm256_store_si256((__m256i*)out + v, _mm256_or_si256(up, down));
+    }
+}
+
+static bool has_avx2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+static const bool HAS_AVX2 = has_avx2();
+
+const char* attack_kernel() {
+    return HAS_AVX2 ? "avx2" : "scalar";
+}
+
+static Bitboard knight_attacks(Bitboard b) {
+    return ((b & NOT_FILE_AB) << 6) | ((b & NOT_FILE_A) << 15)
+         | ((b & NOT_FILE_H) << 17) | ((b & NOT_FILE_GH) << 10)
+         | ((b & NOT_FILE_GH) >> 6) | ((b & NOT_FILE_H) >> 15)
+         | ((b & NOT_FILE_A) >> 17) | ((b & NOT_FILE_AB) >> 10);
+}
+
+static Bitboard king_attacks(Bitboard b) {
+    Bitboard row = b | ((b & NOT_FILE_A) >> 1) | ((b & NOT_FILE_H) << 1);
+    return (row | (row << 8) | (row >> 8)) & ~b;
+}
+
+static Bitboard pawn_attacks(Bitboard b, bool player) {
+    return player ? ((b & NOT_FILE_A) >> 9) | ((b & NOT_FILE_H) >> 7)
+                  : ((b & NOT_FILE_A) << 7) | ((b & NOT_FILE_H) << 9);
+}
+
+static void leaper_maps(const Board &b, AttackMaps *maps) {
+    for(int p = 0; p < 2; ++p) {
+        maps->by_type[p][pt_pawn] = pawn_attacks(b.pieces(p, pt_pawn), p);
+        maps->by_type[p][pt_knight] = knight_attacks(b.pieces(p, pt_knight));
+        maps->by_type[p][pt_king] = king_attacks(b.pieces(p, pt_king));
+    }
+}
+
+static void union_maps(AttackMaps *maps) {
+    for(int p = 0; p < 2; ++p) {
+        maps->all[p] = 0;
+        for(int pt = 0; pt < 6; ++pt)
+            maps->all[p] |= maps->by_type[p][pt];
+    }
+}
+
+static inline void setwise_maps(const Board &b, AttackMaps *maps, SlideKernel slide) {
+    alignas(32) Bitboard gen[NB_GEN], out[NB_GEN];
+    for(int p = 0; p < 2; ++p) {
+        Bitboard *g = gen + 8*p;
+        g[0] = g[1] = b.pieces(p, pt_rook);
+        g[2] = g[3] = b.pieces(p, pt_bishop);
+        g[4] = g[5] = g[6] = g[7] = b.pieces(p, pt_queen);
+    }
+    slide(gen, ~b.occupied(), out);
+    for(int p = 0; p < 2; ++p) {
+        const Bitboard *o = out + 8*p;
+        maps->by_type[p][pt_rook] = o[0] | o[1];
+        maps->by_type[p][pt_bishop] = o[2] | o[3];
+        maps->by_type[p][pt_queen] = o[4] | o[5] | o[6] | o[7];
+    }
+    leaper_maps(b, maps);
+    union_maps(maps);
+}
+
+void attack_maps(const Board &b, AttackMaps *maps) {
+    setwise_maps(b, maps, HAS_AVX2 ? slide_avx2 : slide_scalar);
+}
+
+void attack_maps_scalar(const Board &b, AttackMaps *maps) {
+    setwise_maps(b, maps, slide_scalar);
+}
+
+void attack_maps_magic(const Board &b, AttackMaps *maps) {
+    Bitboard occ = b.occupied();
+    for(int p = 0; p < 2; ++p) {
+        for(int pt : {pt_bishop, pt_rook, pt_queen}) {
+            Bitboard att = 0, sliders = b.pieces(p, pt);
+            while(sliders) {
+                int sq = __builtin_ctzll(sliders);
+                sliders &= sliders - 1;
+                if(pt != pt_rook)
+                    att |= Bmagic(sq, occ);
+                if(pt != pt_bishop)
+                    att |= Rmagic(sq, occ);
+            }
+            maps->by_type[p][pt] = att;
+        }
+    }
+    leaper_maps(b, maps);
+    union_maps(maps);
+}
@@ -0,0 +1,23 @@
+#ifndef ATTACKS_HPP_
+#define ATTACKS_HPP_
+
+#include "board.hpp"
+
+// Squares attacked by each side, own pieces included (they are defended).
+struct AttackMaps {
+    Bitboard by_type[2][6];
+    Bitboard all[2];
+};
+
+/* Attack maps of the whole board in one call. The sliding pieces are
+    filled setwise (Kogge-Stone), four directions at a time in the lanes of
+    an AVX2 register when the processor supports it. */
+void attack_maps(const Board&, AttackMaps*);
+// Same result without AVX2.
+void attack_maps_scalar(const Board&, AttackMaps*);
+// Same result with one magic lookup per slider, for comparison.
+void attack_maps_magic(const Board&, AttackMaps*);
+// "avx2" or "scalar", the kernel used by attack_maps
+const char* attack_kernel();
+
+#endif
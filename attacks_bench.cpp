@@ -0,0 +1,72 @@
+// Micro-benchmark of the attack map kernels (make attacks-bench).
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "attacks.hpp"
+
+using namespace std;
+
+const char* FENS[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1"
+};
+
+static void collect(Board &b, int depth, vector<Board> &positions) {
+    positions.push_back(b);
+    if(depth == 0) return;
+    Move moveList[256];
+    Move *last = b.moves(moveList);
+    for(Move *m = moveList; m < last; ++m) {
+        Board child;
+        b.do_move(*m, &child);
+        collect(child, depth-1, positions);
+    }
+}
+
+static double time_kernel(void (*kernel)(const Board&, AttackMaps*),
+        const vector<Board> &positions, int rounds, Bitboard *checksum) {
+    AttackMaps maps;
+    Bitboard sum = 0;
+    auto start = chrono::steady_clock::now();
+    for(int r = 0; r < rounds; ++r)
+        for(const Board &b : positions) {
+            kernel(b, &maps);
+            sum += maps.all[0] ^ maps.all[1];
+        }
+    *checksum = sum;
+    chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count() / (rounds * positions.size());
+}
+
+int main() {
+    vector<Board> positions;
+    for(const char *fen : FENS) {
+        Board b(fen, {});
+        collect(b, 3, positions);
+    }
+
+    int mismatches = 0;
+    for(const Board &b : positions) {
+        AttackMaps ref, scalar, best;
+        attack_maps_magic(b, &ref);
+        attack_maps_scalar(b, &scalar);
+        attack_maps(b, &best);
+        mismatches += memcmp(&ref, &scalar, sizeof ref) != 0;
+        mismatches += memcmp(&ref, &best, sizeof ref) != 0;
+    }
+    printf("%zu positions, %d mismatches\n", positions.size(), mismatches);
+
+    const int ROUNDS = 20;
+    Bitboard c0, c1, c2;
+    double magic = time_kernel(attack_maps_magic, positions, ROUNDS, &c0);
+    double scalar = time_kernel(attack_maps_scalar, positions, ROUNDS, &c1);
+    double best = time_kernel(attack_maps, positions, ROUNDS, &c2);
+    printf("magic lookups     %6.1f ns per position\n", magic);
+    printf("setwise scalar    %6.1f ns per position\n", scalar);
+    printf("setwise %-6s    %6.1f ns per position\n", attack_kernel(), best);
+    return mismatches || c0 != c1 || c0 != c2;
+}
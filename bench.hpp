@@ -0,0 +1,11 @@
+#ifndef BENCH_HPP_
+#define BENCH_HPP_
+
+// SAkuna bench [depth] [threads] [hash]
+// Searches a fixed set of positions to a fixed depth. With one thread the
+// node count is a signature of the search: it changes with any change of
+// its behaviour. Iterations go two plies at a time, so an odd depth
+// searches as the next even one.
+int bench(int argc, char **argv);
+
+#endif
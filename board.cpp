@@ -3,7 +3,9 @@
 #include <cassert>
 #include <cmath>
 
+#include "endgame.hpp"
 #include "magicmoves.hpp"
+#include "profile.hpp"
 
 using namespace std;
 
@@ -72,7 +74,6 @@ const Bitboard MASK_FILE[8] = {
      4629771061636907072ull,
      9259542123273814144ull
 };
-Bitboard DIAG[64][64];
 Bitboard CASTLING_PATH[4] = {
     MASK_RANK[0] & (MASK_FILE[5] | MASK_FILE[6]),
     MASK_RANK[0] & (MASK_FILE[2] | MASK_FILE[3]),
@@ -80,20 +81,73 @@ Bitboard CASTLING_PATH[4] = {
     MASK_RANK[7] & (MASK_FILE[2] | MASK_FILE[3])
 };
 
-uint64_t ZOBRIST_PIECE[64][12];
-uint64_t ZOBRIST_EXTRA[13];
+// The lookup tables below are computed during compilation.
+
+struct Lines {
+    Bitboard diag[64][64];
+};
+
+// line, from edge to edge, going through two aligned squares
+constexpr Lines init_lines() {
+    Lines lines{};
+    for(int i = 0; i < 64; ++i)
+        for(int j = 0; j < 64; ++j) {
+            int dr = j/8 - i/8, dc = j%8 - i%8;
+            if(i == j || (dr != 0 && dc != 0 && dr != dc && dr != -dc))
+                continue;
+            dr = (dr > 0) - (dr < 0);
+            dc = (dc > 0) - (dc < 0);
+            for(int dir : {-1, 1}) {
+                int r = i/8, c = i%8;
+                while(r >= 0 && r < 8 && c >= 0 && c < 8) {
+                    lines.diag[i][j] |= 1ULL << (8*r+c);
+                    r += dir*dr;
+                    c += dir*dc;
+                }
+            }
+        }
+    return lines;
+}
+
+constexpr Lines LINES = init_lines();
+constexpr const Bitboard (&DIAG)[64][64] = LINES.diag;
+
+struct ZobristKeys {
+    uint64_t piece[64][12];
+    uint64_t extra[13];
+};
+
+// splitmix64
+constexpr uint64_t next_random(uint64_t &seed) {
+    uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+constexpr ZobristKeys init_zobrist() {
+    ZobristKeys keys{};
+    uint64_t seed = 424242;
+    for(int i = 0; i < 64; ++i)
+        for(int j = 0; j < 12; ++j)
+            keys.piece[i][j] = next_random(seed);
+    for(int i = 0; i < 13; ++i)
+        keys.extra[i] = next_random(seed);
+    return keys;
+}
+
+constexpr ZobristKeys ZOBRIST = init_zobrist();
+constexpr const uint64_t (&ZOBRIST_PIECE)[64][12] = ZOBRIST.piece;
+constexpr const uint64_t (&ZOBRIST_EXTRA)[13] = ZOBRIST.extra;
+// the i-th piece of a kind is hashed like a piece on square i
+constexpr const uint64_t (&ZOBRIST_MATERIAL)[64][12] = ZOBRIST.piece;
 
 constexpr bool more_than_one(Bitboard b) {
   return b & (b - 1);
 }
 
 inline int count_bits(Bitboard b) {
-    int cnt = 0;
-    while(b) {
-        b &= (b-1);
-        ++cnt;
-    }
-    return cnt;
+    return __builtin_popcountll(b);
 }
 
 inline Square lsb(Bitboard b) {
@@ -123,28 +177,10 @@ inline bool aligned(Square s1, Square s2, Square s3) {
     return DIAG[s1][s2] & (1LL << s3);
 }
 
-void lookup_table_init() {
-    Board bd = Board();
-    bd.player = 0;
-    bd.allPieces[0] = bd.allPieces[1] = bd.allPieces[2] = 0;
-    for(int i = 0; i < 64; ++i)
-        for(int j = 0; j < 64; ++j) {
-            Bitboard posi = MASK_RANK[i/8] & MASK_FILE[i%8];
-            Bitboard posj = MASK_RANK[j/8] & MASK_FILE[j%8];
-            for(Piece_Type pt : {pt_bishop, pt_rook}) {
-                Bitboard atk = bd.attacks((Square)i, pt);
-                if(atk & posj)
-                    DIAG[i][j] |= atk & bd.attacks((Square)j, pt);
-            }
-            if(DIAG[i][j])
-                DIAG[i][j] |= posi | posj;
-        }
-    srand(424242);
-    for(int i = 0; i < 64; ++i)
-        for(int j = 0; j < 12; ++j)
-            ZOBRIST_PIECE[i][j] = ((u_int64_t)rand()*(u_int64_t)RAND_MAX)+rand();
-    for(int i = 0; i < 13; ++i)
-        ZOBRIST_EXTRA[i] = ((u_int64_t)rand()*(u_int64_t)RAND_MAX)+rand();
+// squares attacked by the pawns of player
+inline Bitboard pawn_attacks_bb(Bitboard b, int player) {
+    return player ? ((b & CLEAR_FILE[FILE_A]) >> 9) | ((b & CLEAR_FILE[FILE_H]) >> 7)
+                  : ((b & CLEAR_FILE[FILE_A]) << 7) | ((b & CLEAR_FILE[FILE_H]) << 9);
 }
 
 void display_bitboard(Bitboard Bb) {
@@ -160,16 +196,34 @@ void display_bitboard(Bitboard Bb) {
 }
 
 Board::Board() {
-    allPieces[0] = allPieces[1] = allPieces[2] = 0;
+    for(int pt = 0; pt < 6; ++pt)
+        byType[pt] = 0;
+    byColor[0] = byColor[1] = 0;
+    init_done = false;
 }
 
-Board::Board(const string &fen, const vector<string> &moves) {
-    pieces[0][pt_pawn]   = pieces[1][pt_pawn]   = 0;
-    pieces[0][pt_knight] = pieces[1][pt_knight] = 0;
-    pieces[0][pt_bishop] = pieces[1][pt_bishop] = 0;
-    pieces[0][pt_rook]   = pieces[1][pt_rook]   = 0;
-    pieces[0][pt_queen]  = pieces[1][pt_queen]  = 0;
-    pieces[0][pt_king]   = pieces[1][pt_king]   = 0;
+// copies the position only, the derived data is computed again by init()
+Board::Board(const Board &other) {
+    *this = other;
+}
+
+Board& Board::operator = (const Board &other) {
+    for(int pt = 0; pt < 6; ++pt)
+        byType[pt] = other.byType[pt];
+    byColor[0] = other.byColor[0];
+    byColor[1] = other.byColor[1];
+    key = other.key;
+    material_key = other.material_key;
+    castling_rights = other.castling_rights;
+    en_passant = other.en_passant;
+    player = other.player;
+    halfmove_clock = other.halfmove_clock;
+    fullmove_number = other.fullmove_number;
+    init_done = false;
+    return *this;
+}
+
+Board::Board(const string &fen, const vector<string> &moves) : Board() {
 
     int row = 7, c = 0, col = 0;
     while(fen[c] != ' ') {
@@ -179,40 +233,40 @@ Board::Board(const string &fen, const vector<string> &moves) {
                 col = -1;
                 break;
             case 'p':
-                pieces[1][pt_pawn] |=  1LL << (8*row+col);
+                toggle(1, pt_pawn, 1LL << (8*row+col));
                 break;
             case 'n':
-                pieces[1][pt_knight] |=  1LL << (8*row+col);
+                toggle(1, pt_knight, 1LL << (8*row+col));
                 break;
             case 'b':
-                pieces[1][pt_bishop] |=  1LL << (8*row+col);
+                toggle(1, pt_bishop, 1LL << (8*row+col));
                 break;
             case 'r':
-                pieces[1][pt_rook] |=  1LL << (8*row+col);
+                toggle(1, pt_rook, 1LL << (8*row+col));
                 break;
             case 'q':
-                pieces[1][pt_queen] |=  1LL << (8*row+col);
+                toggle(1, pt_queen, 1LL << (8*row+col));
                 break;
             case 'k':
-                pieces[1][pt_king] |=  1LL << (8*row+col);
+                toggle(1, pt_king, 1LL << (8*row+col));
                 break;
             case 'P':
-                pieces[0][pt_pawn] |=  1LL << (8*row+col);
+                toggle(0, pt_pawn, 1LL << (8*row+col));
                 break;
             case 'N':
-                pieces[0][pt_knight] |=  1LL << (8*row+col);
+                toggle(0, pt_knight, 1LL << (8*row+col));
                 break;
             case 'B':
-                pieces[0][pt_bishop] |=  1LL << (8*row+col);
+                toggle(0, pt_bishop, 1LL << (8*row+col));
                 break;
             case 'R':
-                pieces[0][pt_rook] |=  1LL << (8*row+col);
+                toggle(0, pt_rook, 1LL << (8*row+col));
                 break;
             case 'Q':
-                pieces[0][pt_queen] |=  1LL << (8*row+col);
+                toggle(0, pt_queen, 1LL << (8*row+col));
                 break;
             case 'K':
-                pieces[0][pt_king] |=  1LL << (8*row+col);
+                toggle(0, pt_king, 1LL << (8*row+col));
                 break;
             default:
                 col += fen[c] - '1';
@@ -252,11 +306,12 @@ Board::Board(const string &fen, const vector<string> &moves) {
         ++c;
     }
     ++c;
-    halfmove_clock = 0;
+    int clock = 0;
     while(c < (int)fen.size() && fen[c] != ' ') {
-        halfmove_clock = halfmove_clock*10+fen[c]-'0';
+        clock = clock*10+fen[c]-'0';
         ++c;
     }
+    halfmove_clock = min(clock, 255);
     ++c;
     fullmove_number = 0;
     while(c < (int)fen.size() && fen[c] != ' ') {
@@ -284,33 +339,32 @@ Board::Board(const string &fen, const vector<string> &moves) {
         Piece_Type us_pt = piece_on(from);
         Piece_Type opp_pt = piece_on(to);
         if(opp_pt != pt_empty) {
-            pieces[!player][opp_pt] ^= 1LL << to;
+            toggle(!player, opp_pt, 1LL << to);
             halfmove_clock = -1;
         }
-        pieces[player][us_pt] ^= (1LL << from) | (1LL << to);
+        toggle(player, us_pt, (1LL << from) | (1LL << to));
         switch(us_pt) {
             case pt_pawn:
                 halfmove_clock = -1;
                 if(r0 == 1+5*player && r1 == 3+player)
                     new_en_passant = Square(8*(2+3*player) + c0);
                 if(to == en_passant)
-                    pieces[!player][pt_pawn] ^=
-                        1LL << (player ? en_passant+8 : en_passant-8);
+                    toggle(!player, pt_pawn, 1LL << (player ? en_passant+8 : en_passant-8));
                 if(r1 == (player ? 0 : 7)) {
                     assert(move.length() > 4);
-                    pieces[player][us_pt] ^= (1LL << to);
+                    toggle(player, us_pt, (1LL << to));
                     switch(move[4]) {
                         case 'q':
-                            pieces[player][pt_queen] ^= (1LL << to);
+                            toggle(player, pt_queen, (1LL << to));
                             break;
                         case 'r':
-                            pieces[player][pt_rook] ^= (1LL << to);
+                            toggle(player, pt_rook, (1LL << to));
                             break;
                         case 'b':
-                            pieces[player][pt_bishop] ^= (1LL << to);
+                            toggle(player, pt_bishop, (1LL << to));
                             break;
                         case 'n':
-                            pieces[player][pt_knight] ^= (1LL << to);
+                            toggle(player, pt_knight, (1LL << to));
                             break;
                         default:
                             assert(false);
@@ -326,12 +380,10 @@ Board::Board(const string &fen, const vector<string> &moves) {
                 // castling
                 if(c1 - c0 == 2) {
                     halfmove_clock = -1;
-                    pieces[player][pt_rook] ^=
-                        (1LL << (8*r0+7)) | (1LL << (8*r0+5));
+                    toggle(player, pt_rook, (1LL << (8*r0+7)) | (1LL << (8*r0+5)));
                 } else if(c0 - c1 == 2) {
                     halfmove_clock = -1;
-                    pieces[player][pt_rook] ^=
-                        (1LL << (8*r0)) | (1LL << (8*r0+3));
+                    toggle(player, pt_rook, (1LL << (8*r0)) | (1LL << (8*r0+3)));
                 }
                 break;
             default:
@@ -342,6 +394,19 @@ Board::Board(const string &fen, const vector<string> &moves) {
         if(player) ++fullmove_number;
         player ^= 1;
     }
+    compute_keys();
+
+    //fprintf(stderr, "%s %lu\n", fen.c_str(), moves.size());
+    //display_bitboard(occupied());
+    //Move moveList[MAX_MOVES];
+    //Move *last = this->moves(moveList);
+    //fprintf(stderr, "# of moves: %lu\n", last-moveList);
+    //for(Move *move = moveList; move < last; ++move)
+    //    fprintf(stderr, "%s\n", move->toString().c_str());
+}
+
+// hash keys from scratch, once the raw data is set
+void Board::compute_keys() {
     key = player ? ZOBRIST_EXTRA[0] : 0;
     for(int i = 0; i < 4; ++i)
         if(castling_rights & (1 << i))
@@ -351,44 +416,34 @@ Board::Board(const string &fen, const vector<string> &moves) {
     Bitboard b;
     for(int p = 0; p < 2; ++p)
         for(int pt = 0; pt < 6; ++pt) {
-            b = pieces[p][pt];
+            b = pieces(p, pt);
             while(b) {
                 key ^= ZOBRIST_PIECE[pop_lsb(&b)][pt+6*p];
             }
         }
-
+    material_key = 0;
+    for(int p = 0; p < 2; ++p)
+        for(int pt = 0; pt < 6; ++pt)
+            for(int i = 0; i < count_bits(pieces(p, pt)); ++i)
+                material_key ^= ZOBRIST_MATERIAL[i][pt+6*p];
     init_done = false;
-    //fprintf(stderr, "%s %lu\n", fen.c_str(), moves.size());
-    //display_bitboard(allPieces[2]);
-    //Move moveList[MAX_MOVES];
-    //Move *last = this->moves(moveList);
-    //fprintf(stderr, "# of moves: %lu\n", last-moveList);
-    //for(Move *move = moveList; move < last; ++move)
-    //    fprintf(stderr, "%s\n", move->toString().c_str());
 }
 
 void Board::init() {
+    PROFILE_SCOPE(ZONE_INIT);
     if(init_done) return;
 
-    allPieces[0] = pieces[0][pt_pawn] | pieces[0][pt_knight] |
-                 pieces[0][pt_bishop] | pieces[0][pt_rook]   |
-                  pieces[0][pt_queen] | pieces[0][pt_king];
-    allPieces[1] = pieces[1][pt_pawn] | pieces[1][pt_knight] |
-                 pieces[1][pt_bishop] | pieces[1][pt_rook]   |
-                  pieces[1][pt_queen] | pieces[1][pt_king];
-    allPieces[2] = allPieces[0] | allPieces[1];
-
     // detect check
-    Square kg = lsb(pieces[player][pt_king]);
+    Square kg = lsb(pieces(player, pt_king));
     checkers = attacks_on(kg);
 
     // compute king blockers
     Bitboard snipers =
         (attacks_empty(kg, pt_rook) &
-            (pieces[!player][pt_rook] | pieces[!player][pt_queen]))
+            (pieces(!player, pt_rook) | pieces(!player, pt_queen)))
         | (attacks_empty(kg, pt_bishop) &
-            (pieces[!player][pt_bishop] | pieces[!player][pt_queen]));
-    Bitboard occupancy = allPieces[2] ^ snipers;
+            (pieces(!player, pt_bishop) | pieces(!player, pt_queen)));
+    Bitboard occupancy = occupied() ^ snipers;
     blockers = 0;
     while(snipers) {
         Square sniper = pop_lsb(&snipers);
@@ -399,6 +454,25 @@ void Board::init() {
         }
     }
 
+    // checks against the enemy king
+    Square their_kg = lsb(pieces(!player, pt_king));
+    Bitboard their_kg_bb = 1LL << their_kg;
+    check_squares[pt_pawn] = pawn_attacks_bb(their_kg_bb, !player);
+    check_squares[pt_knight] = compute_knight(their_kg_bb, 0);
+    check_squares[pt_bishop] = Bmagic(their_kg, occupied());
+    check_squares[pt_rook] = Rmagic(their_kg, occupied());
+    check_squares[pt_queen] = check_squares[pt_bishop] | check_squares[pt_rook];
+    check_squares[pt_king] = 0;
+    snipers = (Rmagic(their_kg, 0) & (pieces(player, pt_rook) | pieces(player, pt_queen)))
+        | (Bmagic(their_kg, 0) & (pieces(player, pt_bishop) | pieces(player, pt_queen)));
+    occupancy = occupied() ^ snipers;
+    discoverers = 0;
+    while(snipers) {
+        Bitboard b = between_bb(their_kg, pop_lsb(&snipers)) & occupancy;
+        if(b && !more_than_one(b))
+            discoverers |= b & byColor[player];
+    }
+
     init_done = true;
 }
 
@@ -472,7 +546,7 @@ Bitboard Board::compute_knight(Bitboard knight_loc, Bitboard own_side) const {
 Bitboard Board::compute_pawn(Bitboard pawn_loc, int player) const {
     /* check the single space infront of the pawn */
     Bitboard pawn_one_step =
-        (player ? pawn_loc >> 8 : pawn_loc << 8) & ~allPieces[2]; 
+        (player ? pawn_loc >> 8 : pawn_loc << 8) & ~occupied(); 
 
     /* for all moves that came from rank 2 (home row) and passed the above 
         filter, thereby being on rank 3, check and see if I can move forward 
@@ -481,7 +555,7 @@ Bitboard Board::compute_pawn(Bitboard pawn_loc, int player) const {
         pawn_one_step & MASK_RANK[player ? RANK_6 : RANK_3];
     Bitboard pawn_two_steps = 
         (player ? pawn_one_step_double >> 8 : pawn_one_step_double << 8) &
-        ~allPieces[2]; 
+        ~occupied(); 
 
     /* the union of the movements dictate the possible moves forward 
         available */
@@ -506,7 +580,7 @@ Bitboard Board::compute_pawn(Bitboard pawn_loc, int player) const {
         pawn_left_attack | pawn_right_attack;
 
     /* Calculate where I can _actually_ attack something */
-    Bitboard pawn_valid_attacks = pawn_attacks & allPieces[!player];
+    Bitboard pawn_valid_attacks = pawn_attacks & byColor[!player];
 
     /* then we combine the two situations in which a pawn can legally 
         attack/move. */
@@ -525,6 +599,7 @@ Bitboard Board::compute_pawn(Bitboard pawn_loc, int player) const {
 }
 
 Move* Board::moves(Move* moveList) {
+    PROFILE_SCOPE(ZONE_MOVES);
     init();
     Move* cur = moveList;
 
@@ -535,11 +610,11 @@ Move* Board::moves(Move* moveList) {
     moveList = make_moves(moveList, pt_queen);
     moveList = make_moves(moveList, pt_king);
     // filter illegal moves
-    Bitboard pinned = blockers & allPieces[player];
-    Square kg = lsb(pieces[player][pt_king]);
+    Bitboard pinned = blockers & byColor[player];
+    Square kg = lsb(pieces(player, pt_king));
     while(cur != moveList) {
         if((pinned || kg == 8*cur->r0 + cur->c0
-                    || ((pieces[player][pt_pawn] & MASK_RANK[cur->r0]
+                    || ((pieces(player, pt_pawn) & MASK_RANK[cur->r0]
                             & MASK_FILE[cur->c0])
                         && en_passant == 8*cur->r1 + cur->c1))
                 && !legal(*cur))
@@ -555,10 +630,10 @@ Bitboard Board::attacks_empty(Square from, Piece_Type pt, int player) {
     Bitboard b;//, from_bb = MASK_RANK[from/8] & MASK_FILE[from%8];
     switch(pt) {
         case pt_bishop:
-            b = Bmagic(from, 0) & ~allPieces[player];
+            b = Bmagic(from, 0) & ~byColor[player];
             break;
         case pt_rook:
-            b = Rmagic(from, 0) & ~allPieces[player];
+            b = Rmagic(from, 0) & ~byColor[player];
             break;
         default:
             assert(false);
@@ -575,20 +650,20 @@ Bitboard Board::attacks(Square from, Piece_Type pt, int player) const {
             b = compute_pawn(from_bb, player);
             break;
         case pt_knight:
-            b = compute_knight(from_bb, allPieces[player]);
+            b = compute_knight(from_bb, byColor[player]);
             break;
         case pt_bishop:
-            b = Bmagic(from, allPieces[2]) & ~allPieces[player];
+            b = Bmagic(from, occupied()) & ~byColor[player];
             break;
         case pt_rook:
-            b = Rmagic(from, allPieces[2]) & ~allPieces[player];
+            b = Rmagic(from, occupied()) & ~byColor[player];
             break;
         case pt_queen:
-            b = Rmagic(from, allPieces[2]) & ~allPieces[player];
-            b |= Bmagic(from, allPieces[2]) & ~allPieces[player];
+            b = Rmagic(from, occupied()) & ~byColor[player];
+            b |= Bmagic(from, occupied()) & ~byColor[player];
             break;
         case pt_king:
-            b = compute_king_incomplete(from_bb, allPieces[player]);
+            b = compute_king_incomplete(from_bb, byColor[player]);
             break;
         default:
             b = 0;
@@ -598,27 +673,27 @@ Bitboard Board::attacks(Square from, Piece_Type pt, int player) const {
 }
 
 Bitboard Board::attacks_on(Square target) const {
-    return (attacks(target, pt_pawn, player) & pieces[!player][pt_pawn])   |
-           (attacks(target, pt_knight)       & pieces[!player][pt_knight]) |
-           (attacks(target, pt_bishop)       & pieces[!player][pt_bishop]) |
-           (attacks(target, pt_rook)         & pieces[!player][pt_rook])   |
-           (attacks(target, pt_queen)        & pieces[!player][pt_queen])  |
-           (attacks(target, pt_king)         & pieces[!player][pt_king]);
+    return (attacks(target, pt_pawn, player) & pieces(!player, pt_pawn))   |
+           (attacks(target, pt_knight)       & pieces(!player, pt_knight)) |
+           (attacks(target, pt_bishop)       & pieces(!player, pt_bishop)) |
+           (attacks(target, pt_rook)         & pieces(!player, pt_rook))   |
+           (attacks(target, pt_queen)        & pieces(!player, pt_queen))  |
+           (attacks(target, pt_king)         & pieces(!player, pt_king));
 }
 
 Move* Board::make_moves(Move* moveList, Piece_Type pt) {
-    Bitboard target = ~allPieces[player];
+    Bitboard target = ~byColor[player];
     if(checkers) {
-        Square kg = lsb(pieces[player][pt_king]);
+        Square kg = lsb(pieces(player, pt_king));
         if(pt == pt_king) {
             Bitboard sliderAttacks = 0;
             Bitboard sliders = checkers &
-                ~(pieces[!player][pt_knight] | pieces[!player][pt_pawn]);
+                ~(pieces(!player, pt_knight) | pieces(!player, pt_pawn));
             while(sliders)
                 sliderAttacks |= DIAG[kg][pop_lsb(&sliders)] & ~checkers;
 
             // Evasions of the king
-            Bitboard b = attacks(kg, pt_king) & ~allPieces[player] & ~sliderAttacks;
+            Bitboard b = attacks(kg, pt_king) & ~byColor[player] & ~sliderAttacks;
             while(b)
                 *moveList++ = Move((int)kg, (int)pop_lsb(&b));
             return moveList;
@@ -634,7 +709,7 @@ Move* Board::make_moves(Move* moveList, Piece_Type pt) {
                 target |= pawn_ep;
         }
     }
-    Bitboard bb = pieces[player][pt], b;
+    Bitboard bb = pieces(player, pt), b;
     Square from;
     while(bb) {
         from = pop_lsb(&bb);
@@ -652,70 +727,175 @@ Move* Board::make_moves(Move* moveList, Piece_Type pt) {
 
     // Castling
     if(pt == pt_king) {
-        Square kg = lsb(pieces[player][pt_king]);
+        Square kg = lsb(pieces(player, pt_king));
         for(int cr = 0; cr < 2; ++cr)
-            if((castling_rights >> (2*player)) & (1+cr) &&
-                    (CASTLING_PATH[2*player+cr] & allPieces[2]) == 0) {
-                bb = CASTLING_PATH[2*player+cr];
-                bool valid = true;
-                while(bb) {
-                    if(attacks_on(pop_lsb(&bb))) {
-                        valid = false;
-                        break;
-                    }
-                }
-                if(!valid) continue;
+            if(can_castle(cr))
                 *moveList++ = Move((int)kg, (int)kg+2-4*cr);
-            }
     }
     return moveList;
 }
 
+// king side if cr is 0, queen side if 1, when not in check
+bool Board::can_castle(int cr) const {
+    if(!((castling_rights >> (2*player)) & (1+cr))
+            || (CASTLING_PATH[2*player+cr] & occupied()))
+        return false;
+    Bitboard bb = CASTLING_PATH[2*player+cr];
+    while(bb)
+        if(attacks_on(pop_lsb(&bb)))
+            return false;
+    return true;
+}
+
+// Counts the legal moves from the destination bitboards, as moves() would
+// generate them, or returns 1 on the first one found if stop_at_first.
+int Board::legal_moves_count(bool stop_at_first) {
+    init();
+    Square kg = lsb(pieces(player, pt_king));
+    int count = 0;
+
+    // the king first, the only piece to move in double check
+    Bitboard sliderAttacks = 0;
+    Bitboard sliders = checkers &
+        ~(pieces(!player, pt_knight) | pieces(!player, pt_pawn));
+    while(sliders)
+        sliderAttacks |= DIAG[kg][pop_lsb(&sliders)] & ~checkers;
+    Bitboard b = attacks(kg, pt_king) & ~sliderAttacks;
+    while(b)
+        if(!attacks_on(pop_lsb(&b))) {
+            if(stop_at_first)
+                return 1;
+            ++count;
+        }
+    if(more_than_one(checkers))
+        return count;
+    if(!checkers)
+        for(int cr = 0; cr < 2; ++cr)
+            if(can_castle(cr)) {
+                if(stop_at_first)
+                    return 1;
+                ++count;
+            }
+
+    Bitboard target = checkers ? between_bb(kg, lsb(checkers)) | checkers : ~byColor[player];
+    Bitboard pawn_target = target;
+    if(checkers && en_passant != SQ_NONE) {
+        Bitboard pawn_ep = 1LL << en_passant;
+        if((player ? pawn_ep << 8 : pawn_ep >> 8) & checkers)
+            pawn_target |= pawn_ep;
+    }
+    for(int pt = pt_pawn; pt < pt_king; ++pt) {
+        Bitboard bb = pieces(player, pt);
+        while(bb) {
+            Square from = pop_lsb(&bb);
+            b = attacks(from, Piece_Type(pt)) & (pt == pt_pawn ? pawn_target : target);
+            // a pinned piece stays on the line of its king
+            if(blockers & (1LL << from))
+                b &= DIAG[kg][from];
+            if(pt == pt_pawn && en_passant != SQ_NONE && (b & (1LL << en_passant))
+                    && !legal(Move((int)from, (int)en_passant)))
+                b ^= 1LL << en_passant;
+            if(!b)
+                continue;
+            if(stop_at_first)
+                return 1;
+            // four promotions per destination
+            count += count_bits(b) * (pt == pt_pawn && from / 8 == (player ? 1 : 6) ? 4 : 1);
+        }
+    }
+    return count;
+}
+
+bool Board::has_legal_move() {
+    return legal_moves_count(true) > 0;
+}
+
+int Board::count_legal_moves() {
+    return legal_moves_count(false);
+}
+
 bool Board::legal(Move m) const {
+    PROFILE_SCOPE(ZONE_LEGAL);
     Square from = Square(8*m.r0 + m.c0);
     Square to = Square(8*m.r1 + m.c1);
 
     // en passant, check if king is in check
     if(piece_on(from) == pt_pawn && en_passant == to) {
-        Square kg = lsb(pieces[player][pt_king]);
+        Square kg = lsb(pieces(player, pt_king));
         Square capsq = Square(player ? to + 8 : to - 8);
         Bitboard occupied =
-            (allPieces[2] ^ (1LL << from) ^ (1LL << capsq)) | (1LL << to);
+            (this->occupied() ^ (1LL << from) ^ (1LL << capsq)) | (1LL << to);
         return !(Rmagic(kg, occupied) &
-                (pieces[!player][pt_rook] | pieces[!player][pt_queen]))
+                (pieces(!player, pt_rook) | pieces(!player, pt_queen)))
             && !(Bmagic(kg, occupied) &
-                (pieces[!player][pt_bishop] | pieces[!player][pt_queen]));
+                (pieces(!player, pt_bishop) | pieces(!player, pt_queen)));
     }
 
     // check if king moved in check
-    if(pieces[player][pt_king] & (1LL << from)) {
+    if(pieces(player, pt_king) & (1LL << from)) {
         return !attacks_on(to);
     }
 
     // A non-king move is legal if and only if it is not pinned or it
     // is moving along the ray towards or away from the king.
     return !(blockers & (1LL << from))
-        || aligned(from, to, lsb(pieces[player][pt_king]));
+        || aligned(from, to, lsb(pieces(player, pt_king)));
+}
+
+// needs init()
+bool Board::gives_check(Move m) const {
+    Square from = Square(8*m.r0 + m.c0);
+    Square to = Square(8*m.r1 + m.c1);
+    Piece_Type pt = piece_on(from);
+    Square their_kg = lsb(pieces(!player, pt_king));
+
+    // direct check
+    if(m.p == 0 && (check_squares[pt] & (1LL << to)))
+        return true;
+    // discovered check, unless moving along the line to the king
+    if((discoverers & (1LL << from)) && !aligned(from, to, their_kg))
+        return true;
+
+    Bitboard occupied = (this->occupied() ^ (1LL << from)) | (1LL << to);
+    if(m.p != 0) {
+        switch(PT_PROM[m.p-1]) {
+            case pt_knight:
+                return check_squares[pt_knight] & (1LL << to);
+            case pt_bishop:
+                return Bmagic(to, occupied) & (1LL << their_kg);
+            case pt_rook:
+                return Rmagic(to, occupied) & (1LL << their_kg);
+            default:
+                return (Bmagic(to, occupied) | Rmagic(to, occupied)) & (1LL << their_kg);
+        }
+    }
+    // the captured pawn can uncover a slider
+    if(pt == pt_pawn && to == en_passant) {
+        occupied ^= 1LL << (player ? to + 8 : to - 8);
+        return (Rmagic(their_kg, occupied) & (pieces(player, pt_rook) | pieces(player, pt_queen)))
+            || (Bmagic(their_kg, occupied) & (pieces(player, pt_bishop) | pieces(player, pt_queen)));
+    }
+    // the castling rook
+    if(pt == pt_king && (m.c1 - m.c0 == 2 || m.c0 - m.c1 == 2)) {
+        Square rook_from = Square(m.c1 > m.c0 ? from + 3 : from - 4);
+        Square rook_to = Square(m.c1 > m.c0 ? from + 1 : from - 1);
+        occupied = (this->occupied() ^ (1LL << from) ^ (1LL << rook_from)) | (1LL << to) | (1LL << rook_to);
+        return Rmagic(rook_to, occupied) & (1LL << their_kg);
+    }
+    return false;
 }
 
 Piece_Type Board::piece_on(Square sq) const {
     for(auto pt : {pt_pawn, pt_knight, pt_bishop, pt_rook, pt_queen, pt_king})
-        if((pieces[0][pt] | pieces[1][pt]) & (1LL << sq))
+        if(byType[pt] & (1LL << sq))
             return pt;
     return pt_empty;
 }
 
 void Board::do_move(Move m, Board* newBd) const {
-    for(int p = 0; p < 2; ++p)
-        for(int pt = 0; pt < 6; ++pt)
-            newBd->pieces[p][pt] = pieces[p][pt];
-    newBd->player = player;
-    newBd->castling_rights = castling_rights;
-    newBd->en_passant = en_passant;
-    newBd->halfmove_clock = halfmove_clock;
-    newBd->fullmove_number = fullmove_number;
-    newBd->init_done = false;
-    newBd->key = key ^ ZOBRIST_EXTRA[0];
+    PROFILE_SCOPE(ZONE_DO_MOVE);
+    *newBd = *this;
+    newBd->key ^= ZOBRIST_EXTRA[0];
 
     for(int i = 0; i < 4; ++i)
         if(castling_rights & (1 << i))
@@ -742,11 +922,13 @@ void Board::do_move(Move m, Board* newBd) const {
     Piece_Type us_pt = piece_on(from);
     Piece_Type opp_pt = piece_on(to);
     if(opp_pt != pt_empty) {
-        newBd->pieces[!player][opp_pt] ^= 1LL << to;
+        newBd->toggle(!player, opp_pt, 1LL << to);
         newBd->key ^= ZOBRIST_PIECE[to][opp_pt+6*(!player)];
+        newBd->material_key ^= ZOBRIST_MATERIAL
+            [count_bits(newBd->pieces(!player, opp_pt))][opp_pt+6*(!player)];
         newBd->halfmove_clock = -1;
     }
-    newBd->pieces[player][us_pt] ^= (1LL << from) | (1LL << to);
+    newBd->toggle(player, us_pt, (1LL << from) | (1LL << to));
     newBd->key ^= ZOBRIST_PIECE[from][us_pt+6*player];
     newBd->key ^= ZOBRIST_PIECE[to][us_pt+6*player];
     switch(us_pt) {
@@ -755,18 +937,23 @@ void Board::do_move(Move m, Board* newBd) const {
             if(r0 == 1+5*player && r1 == 3+player)
                 new_en_passant = Square(8*(2+3*player) + c0);
             if(to == en_passant) {
-                newBd->pieces[!player][pt_pawn] ^=
-                    1LL << (player ? en_passant+8 : en_passant-8);
+                newBd->toggle(!player, pt_pawn, 1LL << (player ? en_passant+8 : en_passant-8));
                 newBd->key ^=
                     ZOBRIST_PIECE[player ? en_passant+8 : en_passant-8]
                         [pt_pawn+6*(!player)];
+                newBd->material_key ^= ZOBRIST_MATERIAL
+                    [count_bits(newBd->pieces(!player, pt_pawn))][pt_pawn+6*(!player)];
             }
             if(r1 == (player ? 0 : 7)) {
-                newBd->pieces[player][us_pt] ^= (1LL << to);
+                newBd->toggle(player, us_pt, (1LL << to));
                 newBd->key ^= ZOBRIST_PIECE[to][us_pt+6*player];
                 assert(m.p != 0);
-                newBd->pieces[player][PT_PROM[m.p-1]] ^= (1LL << to);
+                newBd->toggle(player, PT_PROM[m.p-1], 1LL << to);
                 newBd->key ^= ZOBRIST_PIECE[to][PT_PROM[m.p-1]+6*player];
+                newBd->material_key ^= ZOBRIST_MATERIAL
+                    [count_bits(newBd->pieces(player, pt_pawn))][pt_pawn+6*player]
+                    ^ ZOBRIST_MATERIAL[count_bits(newBd->pieces(player, PT_PROM[m.p-1]))-1]
+                    [PT_PROM[m.p-1]+6*player];
             }
             break;
         case pt_knight:
@@ -778,14 +965,12 @@ void Board::do_move(Move m, Board* newBd) const {
             // castling
             if(c1 - c0 == 2) {
                 newBd->halfmove_clock = -1;
-                newBd->pieces[player][pt_rook] ^=
-                    (1LL << (8*r0+7)) | (1LL << (8*r0+5));
+                newBd->toggle(player, pt_rook, (1LL << (8*r0+7)) | (1LL << (8*r0+5)));
                 newBd->key ^= ZOBRIST_PIECE[8*r0+7][pt_rook+6*player];
                 newBd->key ^= ZOBRIST_PIECE[8*r0+5][pt_rook+6*player];
             } else if(c0 - c1 == 2) {
                 newBd->halfmove_clock = -1;
-                newBd->pieces[player][pt_rook] ^=
-                    (1LL << (8*r0)) | (1LL << (8*r0+3));
+                newBd->toggle(player, pt_rook, (1LL << (8*r0)) | (1LL << (8*r0+3)));
                 newBd->key ^= ZOBRIST_PIECE[8*r0][pt_rook+6*player];
                 newBd->key ^= ZOBRIST_PIECE[8*r0+3][pt_rook+6*player];
             }
@@ -806,8 +991,60 @@ void Board::do_move(Move m, Board* newBd) const {
     newBd->player ^= 1;
 }
 
+// Zobrist key of the position after m, without making the move
+uint64_t Board::key_after(Move m) const {
+    uint64_t k = key ^ ZOBRIST_EXTRA[0];
+    int c0 = m.c0;
+    int r0 = m.r0;
+    int c1 = m.c1;
+    int r1 = m.r1;
+    Square from = Square(8*r0+c0);
+    Square to = Square(8*r1+c1);
+    char new_castling_rights = castling_rights;
+    if((c0 == 0 || c0 == 7) && (r0 == 0 || r0 == 7))
+        new_castling_rights &= 15 ^ (1 << (1-c0/7 + 2*(r0/7)));
+    if((c1 == 0 || c1 == 7) && (r1 == 0 || r1 == 7))
+        new_castling_rights &= 15 ^ (1 << (1-c1/7 + 2*(r1/7)));
+    if(c0 == 4 && r0 == 0)
+        new_castling_rights &= 12;
+    if(c0 == 4 && r0 == 7)
+        new_castling_rights &= 3;
+    for(int i = 0; i < 4; ++i)
+        if((castling_rights ^ new_castling_rights) & (1 << i))
+            k ^= ZOBRIST_EXTRA[1+i];
+    if(en_passant != SQ_NONE)
+        k ^= ZOBRIST_EXTRA[5+en_passant%8];
+    Piece_Type us_pt = piece_on(from);
+    Piece_Type opp_pt = piece_on(to);
+    if(opp_pt != pt_empty)
+        k ^= ZOBRIST_PIECE[to][opp_pt+6*(!player)];
+    k ^= ZOBRIST_PIECE[from][us_pt+6*player];
+    switch(us_pt) {
+        case pt_pawn:
+            if(r0 == 1+5*player && r1 == 3+player)
+                k ^= ZOBRIST_EXTRA[5+c0];
+            if(to == en_passant)
+                k ^= ZOBRIST_PIECE[player ? en_passant+8 : en_passant-8]
+                    [pt_pawn+6*(!player)];
+            if(r1 == (player ? 0 : 7))
+                return k ^ ZOBRIST_PIECE[to][PT_PROM[m.p-1]+6*player];
+            break;
+        case pt_king:
+            if(c1 - c0 == 2)
+                k ^= ZOBRIST_PIECE[8*r0+7][pt_rook+6*player]
+                    ^ ZOBRIST_PIECE[8*r0+5][pt_rook+6*player];
+            else if(c0 - c1 == 2)
+                k ^= ZOBRIST_PIECE[8*r0][pt_rook+6*player]
+                    ^ ZOBRIST_PIECE[8*r0+3][pt_rook+6*player];
+            break;
+        default:
+            break;
+    }
+    return k ^ ZOBRIST_PIECE[to][us_pt+6*player];
+}
+
 bool Board::in_check(int player) const {
-    return attacks_on(lsb(pieces[player][pt_king]));
+    return attacks_on(lsb(pieces(player, pt_king)));
 }
 
 void Board::display() const {
@@ -816,7 +1053,7 @@ void Board::display() const {
         fprintf(stderr, "|");
         for(int j = 0; j < 8; ++j) {
             Piece_Type pt = piece_on(Square(8*(7-i)+j));
-            fprintf(stderr, "%c%c", "PNBRQK."[pt] + (pt != pt_empty) * ((pieces[0][pt] & (1LL << (8*(7-i)+j))) == 0) * ('a' - 'A'), " |"[j==7]);
+            fprintf(stderr, "%c%c", "PNBRQK."[pt] + (pt != pt_empty) * ((pieces(0, pt) & (1LL << (8*(7-i)+j))) == 0) * ('a' - 'A'), " |"[j==7]);
         }
         fprintf(stderr, "\n");
     }
@@ -824,8 +1061,9 @@ void Board::display() const {
 }
 
 // Values taken from https://www.chessprogramming.org/Simplified_Evaluation_Function
-const double VALUES[6] = {100, 320, 330, 500, 900, 20000};
-const double POSITION_TABLE[8][8][8] = {
+const EvalParams eval_params = {
+    {100, 320, 330, 500, 900, 20000},
+    {
     // pawn middle game
     {{ 0,  0,   0,   0,   0,   0,  0,  0},
      {50, 50,  50,  50,  50,  50, 50, 50},
@@ -898,33 +1136,83 @@ const double POSITION_TABLE[8][8][8] = {
      {-30, -10,  20,  30,  30,  20, -10, -30},
      {-30, -30,   0,   0,   0,   0, -30, -30},
      {-50, -30, -30, -30, -30, -30, -30, -50}}
+    }
 };
 
-double Board::eval() const {
+const char* TABLE_NAMES[8] = {"pawn middle game", "knight", "bishop", "rook",
+    "queen", "king middle game", "pawn end game", "king end game"};
+
+// one parameter per line, as written by save_eval_params
+bool load_eval_params(const string& path, EvalParams *params) {
+    FILE *f = fopen(path.c_str(), "r");
+    if(f == nullptr) return false;
+    EvalParams loaded;
+    double *v = param_vector(loaded);
+    int n = 0;
+    while(n < NB_EVAL_PARAMS && fscanf(f, "%lf", &v[n]) == 1)
+        ++n;
+    fclose(f);
+    if(n < NB_EVAL_PARAMS) return false;
+    *params = loaded;
+    return true;
+}
+
+void save_eval_params(const EvalParams& params, FILE *f) {
+    const double *v = param_vector(params);
+    for(int i = 0; i < NB_EVAL_PARAMS; ++i)
+        fprintf(f, "%.2f\n", v[i]);
+}
+
+// the initializer of eval_params above
+void print_eval_params(const EvalParams& params, FILE *f) {
+    fprintf(f, "const EvalParams eval_params = {\n    {");
+    for(int pt = 0; pt < 6; ++pt)
+        fprintf(f, "%s%.0f", pt ? ", " : "", params.values[pt]);
+    fprintf(f, "},\n    {\n");
+    for(int t = 0; t < 8; ++t) {
+        fprintf(f, "    // %s\n", TABLE_NAMES[t]);
+        for(int r = 0; r < 8; ++r) {
+            fprintf(f, "    %s{", r ? " " : "{");
+            for(int c = 0; c < 8; ++c)
+                fprintf(f, "%4.0f%s", params.position_table[t][r][c], c < 7 ? "," : "");
+            fprintf(f, "}%s\n", r < 7 ? "," : t < 7 ? "}," : "}");
+        }
+    }
+    fprintf(f, "    }\n};\n");
+}
+
+double Board::eval(const EvalParams& params) const {
+    PROFILE_SCOPE(ZONE_EVAL);
+    const MaterialEntry *me = material_probe(*this, params);
+    if(me->evaluate)
+        return (player == me->strong ? 1 : -1) * me->evaluate(*this, me->strong, params);
     double sc[3] = {0, 0, 0};
     for(int p = 0; p < 2; ++p)
         for(int pt = 0; pt < 5; ++pt)
-            sc[p] += VALUES[pt] * count_bits(pieces[p][pt]);
+            sc[p] += params.values[pt] * count_bits(pieces(p, pt));
     // trade down if up material
     //sc[2] = 100 * (pow(sc[1], 0.9) - pow(sc[0], 0.9)) / pow(100, 0.9);
-    sc[2] = sc[1] - sc[0];
-    bool endgame = is_endgame(0) && is_endgame(1);
+    sc[2] = sc[1] - sc[0] + me->imbalance;
+    bool endgame = me->endgame;
     Bitboard b;
     for(int p = 0; p < 2; ++p)
         for(int pt = 0; pt < 6; ++pt) {
-            b = pieces[p][pt];
+            b = pieces(p, pt);
             while(b) {
                 Square cur = pop_lsb(&b);
                 if(endgame && (pt == pt_pawn || pt == pt_king))
                     sc[2] += (2*p-1) *
-                      POSITION_TABLE[pt+(pt==pt_pawn?6:2)]
+                      params.position_table[pt+(pt==pt_pawn?6:2)]
                       [p?cur/8:7-cur/8][p?cur%8:7-cur%8];
                 else
                     sc[2] += (2*p-1) *
-                      POSITION_TABLE[pt][p?cur/8:7-cur/8][p?cur%8:7-cur%8];
+                      params.position_table[pt][p?cur/8:7-cur/8][p?cur%8:7-cur%8];
             }
         }
-    return (player ? 1 : -1) * sc[2];
+    double scale = me->scale[sc[2] > 0];
+    if(me->scale_position)
+        scale *= me->scale_position(*this, me->strong);
+    return (player ? 1 : -1) * sc[2] * scale;
     //for(int i = 0; i < 8; ++i)
     //    for(int j = 0; j < 8; ++j)
     //        if(board[i][j]->player >= 0) {
@@ -937,21 +1225,21 @@ double Board::eval() const {
 
 bool Board::operator == (const Board& other) const {
     if(key != other.key) return false;
-    for(int p = 0; p < 2; ++p)
-        for(int pt = 0; pt < 6; ++pt)
-            if(pieces[p][pt] != other.pieces[p][pt])
-                return false;
-    return castling_rights == other.castling_rights
+    for(int pt = 0; pt < 6; ++pt)
+        if(byType[pt] != other.byType[pt])
+            return false;
+    return byColor[0] == other.byColor[0] && byColor[1] == other.byColor[1]
+        && castling_rights == other.castling_rights
         && en_passant == other.en_passant
         && player == other.player;
     //ignores 50 move rule and 3fold repetition
 }
 
-bool Board::is_endgame(bool) const {
-    return pieces[player][pt_queen] == 0 || (
-        !more_than_one(pieces[player][pt_queen]) &&
-        !more_than_one(pieces[player][pt_knight]|pieces[player][pt_bishop]) &&
-        pieces[player][pt_rook] == 0);
+bool Board::is_endgame(bool p) const {
+    return pieces(p, pt_queen) == 0 || (
+        !more_than_one(pieces(p, pt_queen)) &&
+        !more_than_one(pieces(p, pt_knight)|pieces(p, pt_bishop)) &&
+        pieces(p, pt_rook) == 0);
 }
 
 
@@ -1,6 +1,8 @@
 #ifndef BOARD_HPP_
 #define BOARD_HPP_
 
+#include <cstddef>
+#include <cstdint>
 #include <cstdio>
 #include <string>
 #include <vector>
@@ -9,7 +11,7 @@
 
 typedef unsigned long long int Bitboard;
 
-enum Square : int {
+enum Square : int8_t {
   SQ_A1, SQ_B1, SQ_C1, SQ_D1, SQ_E1, SQ_F1, SQ_G1, SQ_H1,
   SQ_A2, SQ_B2, SQ_C2, SQ_D2, SQ_E2, SQ_F2, SQ_G2, SQ_H2,
   SQ_A3, SQ_B3, SQ_C3, SQ_D3, SQ_E3, SQ_F3, SQ_G3, SQ_H3,
@@ -28,24 +30,59 @@ enum Piece_Type :int {
     pt_pawn, pt_knight, pt_bishop, pt_rook, pt_queen, pt_king, pt_empty
 };
 
-void lookup_table_init();
+// Parameters of the evaluation. Each engine instance has its own copy,
+// the built-in one or one loaded with the EvalFile option.
+struct EvalParams {
+    double values[6];
+    double position_table[8][8][8];
+};
+
+const int NB_EVAL_PARAMS = sizeof(EvalParams) / sizeof(double);
+extern const EvalParams eval_params;
+
+// all the parameters as one vector, in declaration order
+inline double* param_vector(EvalParams &params) {
+    return reinterpret_cast<double*>(&params);
+}
+inline const double* param_vector(const EvalParams &params) {
+    return reinterpret_cast<const double*>(&params);
+}
+bool load_eval_params(const std::string&, EvalParams*);
+void save_eval_params(const EvalParams&, FILE*);
+void print_eval_params(const EvalParams&, FILE*);
 
-class Board {
+// The position fills the first two cache lines, the bitboards the first one,
+// and is all that copies and comparisons touch.
+class alignas(64) Board {
     public:
     // raw data
-    Bitboard pieces[2][6];
-    char castling_rights;
+    Bitboard byType[6];
+    Bitboard byColor[2];
+    uint64_t key;
+    // hash of the piece counts, see endgame.hpp
+    uint64_t material_key;
+    uint8_t castling_rights;
     Square en_passant;
     bool player;
-    int halfmove_clock;
-    int fullmove_number;
-    // derived data
+    uint8_t halfmove_clock;
+    uint16_t fullmove_number;
+    // derived data, computed by init() and not copied
     bool init_done;
     Bitboard checkers, blockers;
-    uint64_t key;
-    Bitboard allPieces[3];
+    // squares from which a piece of each type would check the enemy king,
+    // and the pieces whose move can uncover a check
+    Bitboard check_squares[6], discoverers;
     Board();
+    Board(const Board&);
     Board(const std::string&, const std::vector<std::string>&);
+    Board& operator = (const Board&);
+    Bitboard pieces(int p, int pt) const { return byColor[p] & byType[pt]; }
+    Bitboard occupied() const { return byColor[0] | byColor[1]; }
+    void toggle(int p, int pt, Bitboard b) {
+        byType[pt] ^= b;
+        byColor[p] ^= b;
+    }
+    void compute_keys();
     void init();
     Bitboard compute_king_incomplete(Bitboard, Bitboard) const;
     Bitboard compute_knight(Bitboard, Bitboard) const;
@@ -55,17 +92,27 @@ class Board {
     Bitboard attacks_empty(Square, Piece_Type, int player = -1);
     Bitboard attacks_on(Square) const;
     Move* make_moves(Move*, Piece_Type);
+    bool can_castle(int) const;
+    int legal_moves_count(bool);
+    // without generating the moves, for the leaves and perft
+    bool has_legal_move();
+    int count_legal_moves();
     bool legal(Move) const;
+    bool gives_check(Move) const;
     Piece_Type piece_on(Square) const;
     void do_move(Move, Board*) const;
+    uint64_t key_after(Move) const;
     bool in_check(int) const;
     void display() const;
-    double eval() const;
+    double eval(const EvalParams& = eval_params) const;
     bool operator == (const Board&) const;
     bool is_endgame(bool) const;
     ~Board() {};
 };
 
+static_assert(offsetof(Board, key) == 64, "the bitboards must fill one cache line");
+static_assert(offsetof(Board, init_done) <= 128, "the position must fit in two cache lines");
+
 namespace std {
     template <>
     struct hash<Board> {
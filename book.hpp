@@ -0,0 +1,39 @@
+#ifndef BOOK_HPP_
+#define BOOK_HPP_
+
+#include <cstdint>
+
+#include "board.hpp"
+
+// Polyglot book entry, written big-endian, 16 bytes, sorted by key
+struct BookEntry {
+    uint64_t key;
+    // to file, to row, from file, from row, promotion (1 knight .. 4 queen),
+    // 3 bits each but the promotion; castling is the king taking its rook
+    uint16_t move;
+    uint16_t weight;
+    uint32_t learn;
+};
+
+// Polyglot hash of the position. The en passant file only counts when a pawn
+// can take en passant.
+uint64_t polyglot_key(const Board&);
+uint16_t polyglot_move(const Board&, Move);
+
+// Decodes the SAN move of b with its move generator. False if it is not
+// exactly one legal move.
+bool parse_san(Board& b, const char* san, int len, Move*);
+
+// Next move of the main line of the PGN movetext from p to end, skipping move
+// numbers, results, NAGs, comments and variations; comment and variation
+// carry the state from one call to the next. Returns the length of the move
+// found at *san, p left after it, or 0 at the end of the text.
+int next_san(const char*& p, const char* end, int& comment, int& variation, const char** san);
+
+// SAkuna makebook [threads N] [maxply N] [mingames N] [minscore PCT] [out FILE] PGN...
+// Counts the moves of the games up to maxply, keeps those played in at least
+// mingames games and scoring at least minscore percent for their side, and
+// writes them as a Polyglot book weighted by 2 * wins + draws.
+int makebook(int argc, char **argv);
+
+#endif
@@ -0,0 +1,204 @@
+#include "datagen.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sakuna.hpp"
+
+using namespace std;
+
+const int MAX_MOVES = 256;
+const double MATE_SCORE = 1'000'000'000LL;
+// a side keeping this score for RESIGN_PLIES plies in a row wins the game
+const double RESIGN_SCORE = 2000;
+const int RESIGN_PLIES = 4;
+// openings scored beyond this are unbalanced and played again
+const double MAX_OPENING_SCORE = 400;
+const int MAX_GAME_PLIES = 400;
+
+PackedPosition pack_position(const Board &b, double score, int result) {
+    PackedPosition pp;
+    memset(&pp, 0, sizeof pp);
+    int n = 0;
+    for(int sq = 0; sq < 64; ++sq)
+        for(int p = 0; p < 2; ++p)
+            for(int pt = 0; pt < 6; ++pt)
+                if(b.pieces(p, pt) & (1ULL << sq)) {
+                    pp.occupancy |= 1ULL << sq;
+                    pp.pieces[n/2] |= (pt + 6*p) << (4*(n%2));
+                    ++n;
+                }
+    pp.score = (int16_t)max(-32000.0, min(32000.0, score));
+    pp.result = result;
+    pp.flags = b.player | (b.castling_rights << 1);
+    pp.en_passant = b.en_passant;
+    pp.halfmove_clock = b.halfmove_clock;
+    pp.fullmove_number = b.fullmove_number;
+    return pp;
+}
+
+Board unpack_position(const PackedPosition &pp) {
+    Board b;
+    Bitboard occ = pp.occupancy;
+    for(int n = 0; occ; ++n) {
+        int sq = __builtin_ctzll(occ);
+        occ &= occ - 1;
+        int code = (pp.pieces[n/2] >> (4*(n%2))) & 15;
+        b.toggle(code/6, code%6, 1ULL << sq);
+    }
+    b.player = pp.flags & 1;
+    b.castling_rights = (pp.flags >> 1) & 15;
+    b.en_passant = Square(pp.en_passant);
+    b.halfmove_clock = pp.halfmove_clock;
+    b.fullmove_number = pp.fullmove_number;
+    b.compute_keys();
+    return b;
+}
+
+struct DatagenConfig {
+    int threads = max(1u, thread::hardware_concurrency());
+    int games = 1000;
+    int nodes = 5000;
+    int random_plies = 8;
+    int hash = 16;
+    string out = "datagen";
+    uint64_t seed = 0;
+};
+
+static atomic<long long> nb_games, nb_positions;
+
+void random_opening(SAkuna &engine, const Board &start, int plies, mt19937_64 &rng) {
+    Move moveList[MAX_MOVES];
+    while(true) {
+        engine.set_position(start);
+        int ply;
+        for(ply = 0; ply < plies; ++ply) {
+            Board b = engine.position();
+            int nb_moves = b.moves(moveList) - moveList;
+            if(nb_moves == 0) break;
+            engine.play(moveList[rng() % nb_moves]);
+        }
+        Board b = engine.position();
+        if(ply < plies || b.moves(moveList) == moveList)
+            continue;
+        if(abs(engine.search_nodes(1000).second) <= MAX_OPENING_SCORE)
+            return;
+    }
+}
+
+// Play one game, returns its scored positions.
+static vector<PackedPosition> play_game(SAkuna &engine, const DatagenConfig &cfg) {
+    vector<PackedPosition> positions;
+    vector<bool> players;
+    Move moveList[MAX_MOVES];
+    int winning = 0, result = 0;
+    for(int ply = 0; ply < MAX_GAME_PLIES; ++ply) {
+        Board b = engine.position();
+        if(b.moves(moveList) == moveList) {
+            // checkmated side to move loses, stalemate is a draw
+            result = b.in_check(b.player) ? (b.player ? 1 : -1) : 0;
+            break;
+        }
+        if(b.halfmove_clock >= 100)
+            break;
+        pair<Move, double> best = engine.search_nodes(cfg.nodes);
+        double score = best.second;
+        // mates are won positions, not useful scores to learn from
+        if(abs(score) < MATE_SCORE && !b.in_check(b.player)) {
+            positions.push_back(pack_position(b, score, 0));
+            players.push_back(b.player);
+        }
+        // adjudicate, from white's point of view
+        double white = b.player ? -score : score;
+        if(abs(white) >= RESIGN_SCORE) {
+            int side = white > 0 ? 1 : -1;
+            winning = winning * side > 0 ? winning + side : side;
+            if(abs(winning) >= RESIGN_PLIES) {
+                result = side;
+                break;
+            }
+        } else {
+            winning = 0;
+        }
+        if(engine.play(best.first) >= 3)
+            break;
+    }
+    for(size_t i = 0; i < positions.size(); ++i)
+        positions[i].result = players[i] ? -result : result;
+    return positions;
+}
+
+static void datagen_thread(const DatagenConfig &cfg, int idx, int games) {
+    uci u;
+    SAkuna engine(u);
+    engine.set_verbose(false);
+    engine.set_option("Hash", to_string(cfg.hash));
+    mt19937_64 rng(cfg.seed * 1000003 + idx);
+    const Board start(u.start_fen, {});
+    // one file per thread: the threads never wait for each other
+    string path = cfg.out + "_" + to_string(idx) + ".bin";
+    FILE *f = fopen(path.c_str(), "ab");
+    if(f == nullptr) {
+        perror(path.c_str());
+        nb_games += games;
+        return;
+    }
+    for(int game = 0; game < games; ++game) {
+        engine.new_game();
+        random_opening(engine, start, cfg.random_plies, rng);
+        vector<PackedPosition> positions = play_game(engine, cfg);
+        fwrite(positions.data(), sizeof(PackedPosition), positions.size(), f);
+        nb_positions += positions.size();
+        ++nb_games;
+    }
+    fclose(f);
+}
+
+int datagen(int argc, char **argv) {
+    DatagenConfig cfg;
+    for(int i = 0; i + 1 < argc; i += 2) {
+        string name = argv[i];
+        if(name == "threads") cfg.threads = max(1, atoi(argv[i+1]));
+        else if(name == "games") cfg.games = atoi(argv[i+1]);
+        else if(name == "nodes") cfg.nodes = max(1, atoi(argv[i+1]));
+        else if(name == "random") cfg.random_plies = atoi(argv[i+1]);
+        else if(name == "hash") cfg.hash = max(1, atoi(argv[i+1]));
+        else if(name == "out") cfg.out = argv[i+1];
+        else if(name == "seed") cfg.seed = strtoull(argv[i+1], nullptr, 10);
+        else {
+            fprintf(stderr, "datagen: unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    printf("datagen: %d games, %d threads, %d nodes per move, files %s_*.bin\n",
+            cfg.games, cfg.threads, cfg.nodes, cfg.out.c_str());
+    fflush(stdout);
+    auto start_time = chrono::steady_clock::now();
+    vector<thread> threads;
+    for(int i = 0; i < cfg.threads; ++i) {
+        int games = cfg.games / cfg.threads + (i < cfg.games % cfg.threads);
+        threads.emplace_back(datagen_thread, cref(cfg), i, games);
+    }
+    auto report = [&] () {
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+        printf("games %lld positions %lld (%.0f/s)\n", (long long)nb_games,
+                (long long)nb_positions, nb_positions / max(elapsed, 1e-3));
+        fflush(stdout);
+    };
+    while(nb_games < cfg.games) {
+        this_thread::sleep_for(chrono::seconds(1));
+        report();
+    }
+    for(thread &t : threads)
+        t.join();
+    return 0;
+}
@@ -0,0 +1,40 @@
+#ifndef DATAGEN_HPP_
+#define DATAGEN_HPP_
+
+#include <cstdint>
+#include <random>
+
+#include "board.hpp"
+
+class SAkuna;
+
+/* Training position, 32 bytes. The pieces of the occupied squares are
+    listed in square order, 4 bits each (pt + 6*color, low nibble first). */
+struct PackedPosition {
+    uint64_t occupancy;
+    uint8_t pieces[16];
+    // search score in centipawns, side to move's point of view
+    int16_t score;
+    // game result for the side to move: 1 win, 0 draw, -1 loss
+    int8_t result;
+    // bit 0 side to move, bits 1-4 castling rights
+    uint8_t flags;
+    // SQ_NONE if none
+    uint8_t en_passant;
+    uint8_t halfmove_clock;
+    uint16_t fullmove_number;
+};
+
+static_assert(sizeof(PackedPosition) == 32, "PackedPosition must stay 32 bytes");
+
+PackedPosition pack_position(const Board&, double score, int result);
+Board unpack_position(const PackedPosition&);
+
+// Random legal plies from start, played on the engine, until a playable and
+// roughly balanced position is reached.
+void random_opening(SAkuna&, const Board& start, int plies, std::mt19937_64&);
+
+// SAkuna datagen [threads N] [games N] [nodes N] [random N] [hash MB] [out PREFIX] [seed N]
+int datagen(int argc, char **argv);
+
+#endif
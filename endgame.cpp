@@ -0,0 +1,270 @@
+#include "endgame.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+
+// above any material advantage, far below mate scores
+const double KNOWN_WIN = 10000;
+const double BISHOP_PAIR = 30;
+const Bitboard DARK_SQUARES = 0xAA55AA55AA55AA55ULL;
+const int MATERIAL_TABLE_SIZE = 4096;
+
+// each search thread has its own table, no locking needed
+thread_local MaterialEntry material_table[MATERIAL_TABLE_SIZE];
+static atomic<unsigned> material_epoch(0);
+
+static inline int popcount(Bitboard b) {
+    return __builtin_popcountll(b);
+}
+
+static inline int square(Bitboard b) {
+    return __builtin_ctzll(b);
+}
+
+static inline int distance(int s1, int s2) {
+    return max(abs(s1/8 - s2/8), abs(s1%8 - s2%8));
+}
+
+static Bitboard king_attacks(int sq) {
+    Bitboard b = 0;
+    for(int dr = -1; dr <= 1; ++dr)
+        for(int dc = -1; dc <= 1; ++dc) {
+            int r = sq/8 + dr, c = sq%8 + dc;
+            if((dr || dc) && r >= 0 && r < 8 && c >= 0 && c < 8)
+                b |= 1ULL << (8*r+c);
+        }
+    return b;
+}
+
+// squares attacked by a white pawn
+static Bitboard pawn_attacks(int sq) {
+    Bitboard b = 0;
+    if(sq%8 > 0) b |= 1ULL << (sq+7);
+    if(sq%8 < 7) b |= 1ULL << (sq+9);
+    return sq < 56 ? b : 0;
+}
+
+/* KPK bitbase: white king, white pawn on files a-d, black king, side to
+    move. Built by retrograde analysis on first use. */
+namespace kpk {
+
+const int SIZE = 2*24*64*64;
+const int RANK_7 = 6;
+enum Result : uint8_t { INVALID = 0, UNKNOWN = 1, DRAW = 2, WIN = 4 };
+
+unsigned index(int stm, int bk, int wk, int psq) {
+    return stm | (bk << 1) | (wk << 7) | ((psq%8) << 13) | ((RANK_7 - psq/8) << 15);
+}
+
+Result initial(unsigned idx) {
+    int stm = idx & 1, bk = (idx >> 1) & 63, wk = (idx >> 7) & 63;
+    int psq = 8*(RANK_7 - (idx >> 15)) + ((idx >> 13) & 3);
+    if(distance(wk, bk) <= 1 || wk == psq || bk == psq
+            || (stm == 0 && (pawn_attacks(psq) & (1ULL << bk))))
+        return INVALID;
+    // the pawn promotes safely
+    if(stm == 0 && psq/8 == RANK_7 && wk != psq+8
+            && (distance(bk, psq+8) > 1 || distance(wk, psq+8) == 1))
+        return WIN;
+    // stalemate, or the pawn is taken
+    if(stm == 1 && (!(king_attacks(bk) & ~(king_attacks(wk) | pawn_attacks(psq)))
+            || (king_attacks(bk) & (1ULL << psq) & ~king_attacks(wk))))
+        return DRAW;
+    return UNKNOWN;
+}
+
+Result classify(const vector<uint8_t> &db, unsigned idx) {
+    int stm = idx & 1, bk = (idx >> 1) & 63, wk = (idx >> 7) & 63;
+    int psq = 8*(RANK_7 - (idx >> 15)) + ((idx >> 13) & 3);
+    Result good = stm == 0 ? WIN : DRAW;
+    Result bad = stm == 0 ? DRAW : WIN;
+    int r = INVALID;
+    Bitboard b = king_attacks(stm == 0 ? wk : bk);
+    while(b) {
+        int s = square(b);
+        b &= b - 1;
+        r |= stm == 0 ? db[index(1, bk, s, psq)] : db[index(0, s, wk, psq)];
+    }
+    if(stm == 0 && psq/8 < RANK_7) {
+        r |= db[index(1, bk, wk, psq+8)];
+        if(psq/8 == 1 && psq+8 != wk && psq+8 != bk)
+            r |= db[index(1, bk, wk, psq+16)];
+    }
+    return r & good ? good : r & UNKNOWN ? UNKNOWN : bad;
+}
+
+const vector<bool>& bitbase() {
+    static const vector<bool> wins = [] () {
+        vector<uint8_t> db(SIZE);
+        for(unsigned idx = 0; idx < SIZE; ++idx)
+            db[idx] = initial(idx);
+        bool changed = true;
+        while(changed) {
+            changed = false;
+            for(unsigned idx = 0; idx < SIZE; ++idx)
+                if(db[idx] == UNKNOWN && (db[idx] = classify(db, idx)) != UNKNOWN)
+                    changed = true;
+        }
+        vector<bool> wins(SIZE);
+        for(unsigned idx = 0; idx < SIZE; ++idx)
+            wins[idx] = db[idx] == WIN;
+        return wins;
+    }();
+    return wins;
+}
+
+// squares from the strong side's point of view
+bool probe(int stm, int wk, int psq, int bk) {
+    if(psq%8 > 3) {
+        wk ^= 7;
+        psq ^= 7;
+        bk ^= 7;
+    }
+    return bitbase()[index(stm, bk, wk, psq)];
+}
+
+}
+
+// flip the squares of black so that the strong side plays up the board
+static inline int relative(int sq, bool strong) {
+    return strong ? sq ^ 56 : sq;
+}
+
+static double material(const Board &b, bool p, const EvalParams &params) {
+    double sc = 0;
+    for(int pt = 0; pt < 5; ++pt)
+        sc += params.values[pt] * popcount(b.pieces(p, pt));
+    return sc;
+}
+
+// 0 in the center, 6 in the corners
+static int edge_distance(int sq) {
+    return 6 - min(sq/8, 7 - sq/8) - min(sq%8, 7 - sq%8);
+}
+
+static double evaluate_kpk(const Board &b, bool strong, const EvalParams &params) {
+    int wk = relative(square(b.pieces(strong, pt_king)), strong);
+    int bk = relative(square(b.pieces(!strong, pt_king)), strong);
+    int psq = relative(square(b.pieces(strong, pt_pawn)), strong);
+    if(!kpk::probe(b.player != strong, wk, psq, bk))
+        return 0;
+    return KNOWN_WIN + params.values[pt_pawn] + 10 * (psq/8);
+}
+
+// bare king against mating material: drive it to the edge
+static double evaluate_kxk(const Board &b, bool strong, const EvalParams &params) {
+    int sk = square(b.pieces(strong, pt_king));
+    int wk = square(b.pieces(!strong, pt_king));
+    return KNOWN_WIN + material(b, strong, params)
+        + 20 * edge_distance(wk) + 10 * (7 - distance(sk, wk));
+}
+
+// the mate needs a corner of the bishop's color
+static double evaluate_kbnk(const Board &b, bool strong, const EvalParams &params) {
+    int sk = square(b.pieces(strong, pt_king));
+    int wk = square(b.pieces(!strong, pt_king));
+    if(!(b.pieces(strong, pt_bishop) & DARK_SQUARES))
+        wk ^= 7;
+    int corner = min(distance(wk, SQ_A1), distance(wk, SQ_H8));
+    return KNOWN_WIN + material(b, strong, params)
+        + 10 * edge_distance(wk) + 30 * (7 - corner) + 10 * (7 - distance(sk, wk));
+}
+
+static double scale_opposite_bishops(const Board &b, bool) {
+    bool dark0 = b.pieces(0, pt_bishop) & DARK_SQUARES;
+    bool dark1 = b.pieces(1, pt_bishop) & DARK_SQUARES;
+    return dark0 != dark1 ? 0.5 : 1;
+}
+
+// rook pawns with a bishop which does not control the promotion square
+static double scale_wrong_bishop(const Board &b, bool strong) {
+    Bitboard pawns = b.pieces(strong, pt_pawn);
+    const Bitboard FILE_A = 0x0101010101010101ULL;
+    int file;
+    if(!(pawns & ~FILE_A))
+        file = 0;
+    else if(!(pawns & ~(FILE_A << 7)))
+        file = 7;
+    else
+        return 1;
+    int promotion = strong ? file : 56 + file;
+    bool dark = b.pieces(strong, pt_bishop) & DARK_SQUARES;
+    if(dark == bool(DARK_SQUARES & (1ULL << promotion)))
+        return 1;
+    return distance(square(b.pieces(!strong, pt_king)), promotion) <= 1 ? 0 : 1;
+}
+
+static void compute_entry(const Board &b, const EvalParams &params, MaterialEntry &e) {
+    int cnt[2][5];
+    double npm[2] = {0, 0};
+    for(int p = 0; p < 2; ++p)
+        for(int pt = 0; pt < 5; ++pt) {
+            cnt[p][pt] = popcount(b.pieces(p, pt));
+            if(pt != pt_pawn)
+                npm[p] += params.values[pt] * cnt[p][pt];
+        }
+    e.evaluate = nullptr;
+    e.scale_position = nullptr;
+    e.endgame = b.is_endgame(0) && b.is_endgame(1);
+    e.imbalance = BISHOP_PAIR * ((cnt[1][pt_bishop] >= 2) - (cnt[0][pt_bishop] >= 2));
+    e.scale[0] = e.scale[1] = 1;
+
+    bool strong = npm[1] > npm[0] || (npm[1] == npm[0] && cnt[1][pt_pawn] > cnt[0][pt_pawn]);
+    bool weak = !strong;
+    e.strong = strong;
+    bool bare = npm[weak] == 0 && cnt[weak][pt_pawn] == 0;
+    // piece signature of each side: exactly these pieces, pawns aside
+    auto only = [&] (bool p, int n, int b, int r, int q) {
+        return cnt[p][pt_knight] == n && cnt[p][pt_bishop] == b
+            && cnt[p][pt_rook] == r && cnt[p][pt_queen] == q;
+    };
+
+    if(bare && only(strong, 0, 0, 0, 0) && cnt[strong][pt_pawn] == 1) {
+        e.evaluate = evaluate_kpk;
+    } else if(bare && only(strong, 1, 1, 0, 0) && cnt[strong][pt_pawn] == 0) {
+        e.evaluate = evaluate_kbnk;
+    } else if(bare && (cnt[strong][pt_queen] || cnt[strong][pt_rook]
+            || (cnt[strong][pt_bishop] && cnt[strong][pt_knight])
+            || cnt[strong][pt_bishop] >= 2)) {
+        e.evaluate = evaluate_kxk;
+    } else if(bare && only(strong, 0, 1, 0, 0)) {
+        e.scale_position = scale_wrong_bishop;
+    } else if(only(0, 0, 1, 0, 0) && only(1, 0, 1, 0, 0)) {
+        e.scale_position = scale_opposite_bishops;
+    }
+
+    // without pawns, a minor piece up is not enough to win; the weak side
+    // keeps its winning chances if it has pawns
+    if(!e.evaluate && cnt[strong][pt_pawn] == 0) {
+        if(bare && only(strong, 2, 0, 0, 0))
+            e.scale[strong] = 0;
+        else if(npm[strong] - npm[weak] <= params.values[pt_bishop])
+            e.scale[strong] = npm[strong] < params.values[pt_rook] ? 0 : 0.25;
+        if(cnt[weak][pt_pawn] == 0)
+            e.scale[weak] = e.scale[strong];
+    }
+}
+
+void endgame_init() {
+    kpk::bitbase();
+}
+
+const MaterialEntry* material_probe(const Board &b, const EvalParams &params) {
+    MaterialEntry &e = material_table[b.material_key & (MATERIAL_TABLE_SIZE - 1)];
+    unsigned epoch = material_epoch.load(memory_order_relaxed);
+    if(e.key != b.material_key || e.params != &params || e.epoch != epoch) {
+        compute_entry(b, params, e);
+        e.key = b.material_key;
+        e.params = &params;
+        e.epoch = epoch;
+    }
+    return &e;
+}
+
+void material_params_changed() {
+    ++material_epoch;
+}
@@ -0,0 +1,45 @@
+#ifndef ENDGAME_HPP_
+#define ENDGAME_HPP_
+
+#include <cstdint>
+
+#include "board.hpp"
+
+// Score of a known ending, from the point of view of the strong side.
+typedef double (*EndgameEval)(const Board&, bool strong, const EvalParams&);
+// Factor applied to the generic evaluation of a drawish ending.
+typedef double (*EndgameScale)(const Board&, bool strong);
+
+/* Everything in the evaluation that only depends on the material on the
+    board, computed once per material signature (Board::material_key). */
+struct MaterialEntry {
+    uint64_t key;
+    // piece values the entry was computed with, and their version
+    const EvalParams *params;
+    unsigned epoch;
+    // replaces the generic evaluation when set
+    EndgameEval evaluate;
+    // refines scale for the actual position when set
+    EndgameScale scale_position;
+    // side the two functions above are called for
+    bool strong;
+    // use the endgame king and pawn tables
+    bool endgame;
+    // black minus white, added to the generic evaluation
+    double imbalance;
+    // factor of the generic evaluation when it favours each side
+    double scale[2];
+};
+
+// Build the KPK bitbase now rather than in the first search reaching KPK.
+void endgame_init();
+
+// Entry of the calling thread's material table for the position, computed
+// with the piece values of params.
+const MaterialEntry* material_probe(const Board&, const EvalParams&);
+
+// Call when parameters change in place: the entries of every thread computed
+// with the previous values are computed again.
+void material_params_changed();
+
+#endif
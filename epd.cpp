@@ -0,0 +1,208 @@
+#include "epd.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "book.hpp"
+#include "sakuna.hpp"
+
+using namespace std;
+
+struct EpdPosition {
+    string id;
+    Board board;
+    // best moves and moves to avoid, in SAN
+    vector<string> best, avoid;
+};
+
+struct EpdResult {
+    bool solved = false;
+    // first iteration from which the best move was right, if solved
+    int depth = 0;
+    double seconds = 0;
+    uint64_t nodes = 0;
+    string move;
+};
+
+struct EpdConfig {
+    int concurrency = max(1u, thread::hardware_concurrency());
+    int movetime = 0;
+    int depth = 0;
+    int nodes = 0;
+    int hash = 16;
+    string file;
+    vector<pair<string, string>> options;
+};
+
+// "fen4 op operand...; op operand...;", with quoted operands
+static bool parse_epd_line(const string &line, EpdPosition *pos) {
+    istringstream in(line);
+    string fen, field;
+    int n;
+    for(n = 0; n < 4 && in >> field; ++n)
+        fen += (n ? " " : "") + field;
+    if(n < 4)
+        return false;
+    pos->board = Board(fen + " 0 1", {});
+    string rest;
+    getline(in, rest);
+    istringstream ops(rest);
+    string op;
+    while(getline(ops, op, ';')) {
+        istringstream words(op);
+        string code, operand;
+        if(!(words >> code))
+            continue;
+        vector<string> operands;
+        while(words >> operand) {
+            if(operand[0] == '"')
+                while(operand.back() != '"' || operand.size() == 1) {
+                    string next;
+                    if(!(words >> next)) break;
+                    operand += " " + next;
+                }
+            if(operand.size() >= 2 && operand[0] == '"' && operand.back() == '"')
+                operand = operand.substr(1, operand.size() - 2);
+            operands.push_back(operand);
+        }
+        if(code == "id" && !operands.empty())
+            pos->id = operands[0];
+        else if(code == "bm")
+            pos->best = operands;
+        else if(code == "am")
+            pos->avoid = operands;
+    }
+    return !pos->best.empty() || !pos->avoid.empty();
+}
+
+// the moves of a bm or am operation, that are legal in b
+static vector<Move> decode_moves(Board b, const vector<string> &sans) {
+    vector<Move> moves;
+    Move m;
+    for(const string &san : sans)
+        if(parse_san(b, san.c_str(), san.size(), &m))
+            moves.push_back(m);
+    return moves;
+}
+
+struct EpdRun {
+    const EpdConfig &cfg;
+    const vector<EpdPosition> &positions;
+    vector<EpdResult> results;
+    atomic<size_t> next{0};
+    mutex print_mutex;
+    EpdRun(const EpdConfig &c, const vector<EpdPosition> &p) :
+        cfg(c), positions(p), results(p.size()) {}
+
+    void solve(SAkuna &engine, const EpdPosition &pos, EpdResult *res) {
+        vector<Move> best = decode_moves(pos.board, pos.best);
+        vector<Move> avoid = decode_moves(pos.board, pos.avoid);
+        auto correct = [&] (Move m) {
+            return (pos.best.empty() || find(best.begin(), best.end(), m) != best.end())
+                && find(avoid.begin(), avoid.end(), m) == avoid.end();
+        };
+        engine.new_game();
+        engine.set_position(pos.board);
+        auto start_time = chrono::steady_clock::now();
+        pair<Move, double> result = engine.search_nodes(cfg.nodes, cfg.movetime, cfg.depth,
+                [&] (int depth, Move m) {
+            if(!correct(m)) {
+                res->solved = false;
+            } else if(!res->solved) {
+                res->solved = true;
+                res->depth = depth;
+                res->seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+            }
+        });
+        res->solved = res->solved && correct(result.first);
+        res->nodes = engine.nodes_searched();
+        res->move = result.first.toString();
+    }
+
+    void worker() {
+        uci u;
+        SAkuna engine(u);
+        engine.set_verbose(false);
+        engine.set_option("Hash", to_string(cfg.hash));
+        for(const auto &opt : cfg.options)
+            engine.set_option(opt.first, opt.second);
+        size_t i;
+        while((i = next++) < positions.size()) {
+            EpdResult &res = results[i];
+            solve(engine, positions[i], &res);
+            lock_guard<mutex> lock(print_mutex);
+            printf("%-12s %-8s %-6s", positions[i].id.c_str(),
+                    res.solved ? "solved" : "failed", res.move.c_str());
+            if(res.solved)
+                printf(" depth %2d time %7.3f", res.depth, res.seconds);
+            printf("\n");
+            fflush(stdout);
+        }
+    }
+};
+
+int epd(int argc, char **argv) {
+    EpdConfig cfg;
+    for(int i = 0; i < argc; ++i) {
+        string arg = argv[i];
+        size_t eq = arg.find('=');
+        bool has_value = i + 1 < argc;
+        if(eq != string::npos) cfg.options.emplace_back(arg.substr(0, eq), arg.substr(eq + 1));
+        else if(arg == "concurrency" && has_value) cfg.concurrency = max(1, atoi(argv[++i]));
+        else if(arg == "movetime" && has_value) cfg.movetime = max(0, atoi(argv[++i]));
+        else if(arg == "depth" && has_value) cfg.depth = max(0, atoi(argv[++i]));
+        else if(arg == "nodes" && has_value) cfg.nodes = max(0, atoi(argv[++i]));
+        else if(arg == "hash" && has_value) cfg.hash = max(1, atoi(argv[++i]));
+        else cfg.file = arg;
+    }
+    if(cfg.movetime == 0 && cfg.depth == 0 && cfg.nodes == 0)
+        cfg.movetime = 1000;
+    ifstream in(cfg.file);
+    if(!in) {
+        fprintf(stderr, "epd: cannot read %s\n", cfg.file.c_str());
+        return 1;
+    }
+    vector<EpdPosition> positions;
+    string line;
+    while(getline(in, line)) {
+        EpdPosition pos;
+        if(parse_epd_line(line, &pos)) {
+            if(pos.id.empty())
+                pos.id = to_string(positions.size() + 1);
+            positions.push_back(pos);
+        }
+    }
+    printf("epd: %d positions, concurrency %d, movetime %d depth %d nodes %d\n",
+            (int)positions.size(), cfg.concurrency, cfg.movetime, cfg.depth, cfg.nodes);
+    fflush(stdout);
+    auto start_time = chrono::steady_clock::now();
+    EpdRun run(cfg, positions);
+    vector<thread> threads;
+    for(int i = 0; i < cfg.concurrency; ++i)
+        threads.emplace_back(&EpdRun::worker, &run);
+    for(thread &t : threads)
+        t.join();
+    int solved = 0;
+    double seconds = 0;
+    uint64_t nodes = 0;
+    for(const EpdResult &res : run.results) {
+        solved += res.solved;
+        if(res.solved)
+            seconds += res.seconds;
+        nodes += res.nodes;
+    }
+    printf("solved %d/%d average time to solve %.3f s total nodes %llu in %.1f s\n",
+            solved, (int)positions.size(), solved ? seconds / solved : 0.0,
+            (unsigned long long)nodes,
+            chrono::duration<double>(chrono::steady_clock::now() - start_time).count());
+    return 0;
+}
@@ -0,0 +1,11 @@
+#ifndef EPD_HPP_
+#define EPD_HPP_
+
+// SAkuna epd [concurrency N] [movetime MS] [depth N] [nodes N] [hash MB]
+//            [Option=value]... FILE
+// Searches the positions of an EPD suite on a pool of engines and checks the
+// best move against its bm (or am) operation. A position is solved at the
+// first iteration whose best move stays correct until the end of the search.
+int epd(int argc, char **argv);
+
+#endif
@@ -61,7 +61,7 @@ const unsigned int magicmoves_r_shift[64]=
 	53, 54, 54, 53, 53, 53, 53, 53
 };
 
-const U64 magicmoves_r_magics[64]=
+constexpr U64 magicmoves_r_magics[64]=
 {
 	C64(0x0080001020400080), C64(0x0040001000200040), C64(0x0080081000200080), C64(0x0080040800100080),
 	C64(0x0080020400080080), C64(0x0080010200040080), C64(0x0080008001000200), C64(0x0080002040800100),
@@ -80,7 +80,7 @@ const U64 magicmoves_r_magics[64]=
 	C64(0x00FFFCDDFCED714A), C64(0x007FFCDDFCED714A), C64(0x003FFFCDFFD88096), C64(0x0000040810002101),
 	C64(0x0001000204080011), C64(0x0001000204000801), C64(0x0001000082000401), C64(0x0001FFFAABFAD1A2)
 };
-const U64 magicmoves_r_mask[64]=
+constexpr U64 magicmoves_r_mask[64]=
 {	
 	C64(0x000101010101017E), C64(0x000202020202027C), C64(0x000404040404047A), C64(0x0008080808080876),
 	C64(0x001010101010106E), C64(0x002020202020205E), C64(0x004040404040403E), C64(0x008080808080807E),
@@ -113,7 +113,7 @@ const unsigned int magicmoves_b_shift[64]=
 	58, 59, 59, 59, 59, 59, 59, 58
 };
 
-const U64 magicmoves_b_magics[64]=
+constexpr U64 magicmoves_b_magics[64]=
 {
 	C64(0x0002020202020200), C64(0x0002020202020000), C64(0x0004010202000000), C64(0x0004040080000000),
 	C64(0x0001104000000000), C64(0x0000821040000000), C64(0x0000410410400000), C64(0x0000104104104000),
@@ -134,7 +134,7 @@ const U64 magicmoves_b_magics[64]=
 };
 
 
-const U64 magicmoves_b_mask[64]=
+constexpr U64 magicmoves_b_mask[64]=
 {
 	C64(0x0040201008040200), C64(0x0000402010080400), C64(0x0000004020100A00), C64(0x0000000040221400),
 	C64(0x0000000002442800), C64(0x0000000204085000), C64(0x0000020408102000), C64(0x0002040810204000),
@@ -177,7 +177,7 @@ const U64* magicmoves_b_indices[64]=
 };
 #else
 	#ifndef PERFECT_MAGIC_HASH
-		U64 magicmovesbdb[64][1<<9];
+		//magicmoves_db is defined after the move generators below
 	#else
 		U64 magicmovesbdb[1428];
 		PERFECT_MAGIC_HASH magicmoves_b_indices[64][1<<9];
@@ -207,26 +207,25 @@ const U64* magicmoves_r_indices[64]=
 };
 #else
 	#ifndef PERFECT_MAGIC_HASH
-		U64 magicmovesrdb[64][1<<12];
 	#else
 		U64 magicmovesrdb[4900];
 		PERFECT_MAGIC_HASH magicmoves_r_indices[64][1<<12];
 	#endif
 #endif
 
-U64 initmagicmoves_occ(const int* squares, const int numSquares, const U64 linocc)
+constexpr U64 initmagicmoves_occ(const int* squares, const int numSquares, const U64 linocc)
 {
-	int i;
+	int i=0;
 	U64 ret=0;
 	for(i=0;i<numSquares;i++)
 		if(linocc&(((U64)(1))<<i)) ret|=(((U64)(1))<<squares[i]);
 	return ret;
 }
 
-U64 initmagicmoves_Rmoves(const int square, const U64 occ)
+constexpr U64 initmagicmoves_Rmoves(const int square, const U64 occ)
 {
 	U64 ret=0;
-	U64 bit;
+	U64 bit=0;
 	U64 rowbits=(((U64)0xFF)<<(8*(square/8)));
 	
 	bit=(((U64)(1))<<square);
@@ -258,11 +257,11 @@ U64 initmagicmoves_Rmoves(const int square, const U64 occ)
 	return ret;
 }
 
-U64 initmagicmoves_Bmoves(const int square, const U64 occ)
+constexpr U64 initmagicmoves_Bmoves(const int square, const U64 occ)
 {
 	U64 ret=0;
-	U64 bit;
-	U64 bit2;
+	U64 bit=0;
+	U64 bit2=0;
 	U64 rowbits=(((U64)0xFF)<<(8*(square/8)));
 	
 	bit=(((U64)(1))<<square);
@@ -304,6 +303,64 @@ U64 initmagicmoves_Bmoves(const int square, const U64 occ)
 	return ret;
 }
 
+//for bitscans :
+//initmagicmoves_bitpos64_database[(x*C64(0x07EDD5E59A4E28C2))>>58]
+constexpr int initmagicmoves_bitpos64_database[64]={
+63,  0, 58,  1, 59, 47, 53,  2,
+60, 39, 48, 27, 54, 33, 42,  3,
+61, 51, 37, 40, 49, 18, 28, 20,
+55, 30, 34, 11, 43, 14, 22,  4,
+62, 57, 46, 52, 38, 26, 32, 41,
+50, 36, 17, 19, 29, 10, 13, 21,
+56, 45, 25, 31, 35, 16,  9, 12,
+44, 24, 15,  8, 23,  7,  6,  5};
+
+#if !defined(MINIMIZE_MAGIC) && !defined(PERFECT_MAGIC_HASH)
+//fills every occupancy of every square, as initmagicmoves does for the other
+//configurations, but during compilation
+constexpr magicmoves_db_t initmagicmoves_db(void)
+{
+	magicmoves_db_t db{};
+	for(int i=0;i<64;i++)
+	{
+		int squares[64]={};
+		int numsquares=0;
+		U64 temp=magicmoves_b_mask[i];
+		while(temp)
+		{
+			U64 bit=temp&-temp;
+			squares[numsquares++]=initmagicmoves_bitpos64_database[(bit*C64(0x07EDD5E59A4E28C2))>>58];
+			temp^=bit;
+		}
+		for(temp=0;temp<(((U64)(1))<<numsquares);temp++)
+		{
+			U64 tempocc=initmagicmoves_occ(squares,numsquares,temp);
+			db.b[i][(tempocc*magicmoves_b_magics[i])>>MINIMAL_B_BITS_SHIFT(i)]=initmagicmoves_Bmoves(i,tempocc);
+		}
+	}
+	for(int i=0;i<64;i++)
+	{
+		int squares[64]={};
+		int numsquares=0;
+		U64 temp=magicmoves_r_mask[i];
+		while(temp)
+		{
+			U64 bit=temp&-temp;
+			squares[numsquares++]=initmagicmoves_bitpos64_database[(bit*C64(0x07EDD5E59A4E28C2))>>58];
+			temp^=bit;
+		}
+		for(temp=0;temp<(((U64)(1))<<numsquares);temp++)
+		{
+			U64 tempocc=initmagicmoves_occ(squares,numsquares,temp);
+			db.r[i][(tempocc*magicmoves_r_magics[i])>>MINIMAL_R_BITS_SHIFT(i)]=initmagicmoves_Rmoves(i,tempocc);
+		}
+	}
+	return db;
+}
+
+alignas(64) constexpr magicmoves_db_t magicmoves_db=initmagicmoves_db();
+#else
+
 //used so that the original indices can be left as const so that the compiler can optimize better
 
 #ifndef PERFECT_MAGIC_HASH
@@ -324,18 +381,6 @@ void initmagicmoves(void)
 {
 	int i;
 
-	//for bitscans :
-	//initmagicmoves_bitpos64_database[(x*C64(0x07EDD5E59A4E28C2))>>58]
-	int initmagicmoves_bitpos64_database[64]={
-	63,  0, 58,  1, 59, 47, 53,  2,
-	60, 39, 48, 27, 54, 33, 42,  3,
-	61, 51, 37, 40, 49, 18, 28, 20,
-	55, 30, 34, 11, 43, 14, 22,  4,
-	62, 57, 46, 52, 38, 26, 32, 41,
-	50, 36, 17, 19, 29, 10, 13, 21,
-	56, 45, 25, 31, 35, 16,  9, 12,
-	44, 24, 15,  8, 23,  7,  6,  5};
-
 #ifdef MINIMIZE_MAGIC
 	//identical to magicmove_x_indices except without the const modifer
 	U64* magicmoves_b_indices2[64]=
@@ -461,3 +506,4 @@ void initmagicmoves(void)
 		}
 	}
 }
+#endif //!MINIMIZE_MAGIC && !PERFECT_MAGIC_HASH
@@ -5,7 +5,9 @@
  *need this functionality.
  *
  *Usage:
- *You must first initialize the generator with a call to initmagicmoves().
+ *With MINIMIZE_MAGIC or PERFECT_MAGIC_HASH, you must first initialize the
+ *generator with a call to initmagicmoves(). The default database is built at
+ *compile time and needs no initialization.
  *Then you can use the following macros for generating move bitboards by
  *giving them a square and an occupancy.  The macro will then "return"
  *the correct move bitboard for that particular square and occupancy. It
@@ -157,8 +159,15 @@ extern const unsigned int magicmoves_r_shift[64];
 			#define RmagicNOMASK(square, occupancy) magicmovesrdb[square][((occupancy)*magicmoves_r_magics[square])>>MINIMAL_R_BITS_SHIFT(square)]
 		#endif //USE_INLINING
 
-		extern U64 magicmovesbdb[64][1<<9];
-		extern U64 magicmovesrdb[64][1<<12];
+		//built at compile time, shared read-only between processes
+		struct magicmoves_db_t
+		{
+			U64 b[64][1<<9];
+			U64 r[64][1<<12];
+		};
+		extern const magicmoves_db_t magicmoves_db;
+		#define magicmovesbdb magicmoves_db.b
+		#define magicmovesrdb magicmoves_db.r
 
 	#endif //MINIMIAZE_MAGICMOVES
 #else //PERFCT_MAGIC_HASH defined
@@ -245,6 +254,8 @@ extern const unsigned int magicmoves_r_shift[64];
 
 #endif //USE_INLINING
 
+#if defined(MINIMIZE_MAGIC) || defined(PERFECT_MAGIC_HASH)
 void initmagicmoves(void);
+#endif
 
 #endif //_magicmoveshvesh
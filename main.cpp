@@ -1,9 +1,31 @@
 #include <bits/stdc++.h>
 
+#include "bench.hpp"
+#include "book.hpp"
+#include "datagen.hpp"
+#include "epd.hpp"
+#include "match.hpp"
 #include "sakuna.hpp"
+#include "spsa.hpp"
+#include "tune.hpp"
 #include "uci.hpp"
 
-int main() {
+int main(int argc, char **argv) {
+    if(argc > 1 && std::string(argv[1]) == "bench")
+        return bench(argc-2, argv+2);
+    if(argc > 1 && std::string(argv[1]) == "datagen")
+        return datagen(argc-2, argv+2);
+    if(argc > 1 && std::string(argv[1]) == "tune")
+        return tune(argc-2, argv+2);
+    if(argc > 1 && std::string(argv[1]) == "match")
+        return match(argc-2, argv+2);
+    if(argc > 1 && std::string(argv[1]) == "makebook")
+        return makebook(argc-2, argv+2);
+    if(argc > 1 && std::string(argv[1]) == "epd")
+        return epd(argc-2, argv+2);
+    if(argc > 1 && std::string(argv[1]) == "spsa")
+        return spsa(argc-2, argv+2);
+
     uci uci;
     SAkuna engine = SAkuna(uci);
 
@@ -11,6 +33,18 @@ int main() {
     uci.receive_uci.connect([&] ()
     {
         uci.send_id("Sakuna 0.0", "Akulen");
+        uci.send_option_hash(64, 1, 65536);
+        uci.send_option_string("SharedHash", "<empty>");
+        uci.send_option_check_box("LargePages", true);
+        uci.send_option_string("ExperienceFile", "<empty>");
+        uci.send_option_spin_wheel("ExperienceSize", 64, 1, 65536);
+        uci.send_option_spin_wheel("ExperienceDepth", 8, 1, 64);
+        uci.send_option_string("EvalFile", "<empty>");
+        uci.send_option_spin_wheel("Threads", 1, 1, 256);
+        for(const TunableParam &t : tunable_params)
+            uci.send_option_spin_wheel(t.name, t.get(default_search_params, eval_params),
+                    t.min, t.max);
+        uci.send_option_multi_principle_variation(1, 1, 32);
         //uci.send_option_uci_limit_strength(false);
         uci.send_uci_ok();
     });
@@ -19,6 +53,14 @@ int main() {
         engine.init();    
         uci.send_ready_ok();
     });
+    uci.receive_set_option.connect([&] (const std::string& name, const std::string& value)
+    {
+        engine.set_option(name, value);
+    });
+    uci.receive_uci_new_game.connect([&] ()
+    {
+        engine.new_game();
+    });
     uci.receive_position.connect([&] (const std::string& fen, const std::vector<std::string>& moves)
     {
         engine.set_position(fen, moves);
@@ -33,9 +75,19 @@ int main() {
                 atoi(commands.at(uci::command::white_time).c_str()) : 100'000;
             int btime = commands.count(uci::command::black_time) ?
                 atoi(commands.at(uci::command::black_time).c_str()) : 100'000;
-            engine.start_search(wtime, btime);
+            int depth = commands.count(uci::command::depth) ?
+                atoi(commands.at(uci::command::depth).c_str()) : 0;
+            engine.start_search(wtime, btime, depth);
         }
     });
+    uci.receive_analyze_game.connect([&] (const std::string& fen, const std::vector<std::string>& moves, int depth)
+    {
+        engine.analyze_game(fen, moves, depth);
+    });
+    uci.receive_stats.connect([&] ()
+    {
+        engine.print_stats();
+    });
 
     // Start communication with the UI through console.
     uci.launch();
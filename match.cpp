@@ -0,0 +1,264 @@
+#include "match.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "datagen.hpp"
+#include "sakuna.hpp"
+
+using namespace std;
+
+const int MAX_MOVES = 256;
+// a side keeping this score for RESIGN_PLIES plies in a row wins the game
+const double RESIGN_SCORE = 2000;
+const int RESIGN_PLIES = 4;
+// both engines agreeing on a dead draw for DRAW_PLIES plies after DRAW_MIN_PLY
+const double DRAW_SCORE = 10;
+const int DRAW_PLIES = 8;
+const int DRAW_MIN_PLY = 80;
+const int MAX_GAME_PLIES = 400;
+
+struct MatchConfig {
+    int games = 1000;
+    int concurrency = max(1u, thread::hardware_concurrency());
+    int nodes = 0;
+    int movetime = 0;
+    int random_plies = 8;
+    double elo0 = 0, elo1 = 5, alpha = 0.05, beta = 0.05;
+    vector<string> openings;
+    // engine options, A then B
+    vector<pair<string, string>> options[2];
+};
+
+struct MatchStats {
+    int wins = 0, draws = 0, losses = 0;
+    int games() const { return wins + draws + losses; }
+    double mean() const { return games() ? (wins + 0.5*draws) / games() : 0.5; }
+    double variance() const {
+        double m = mean();
+        return games() ? (wins*(1-m)*(1-m) + draws*(0.5-m)*(0.5-m) + losses*m*m) / games() : 0;
+    }
+};
+
+static double elo(double score) {
+    score = max(1e-6, min(1 - 1e-6, score));
+    return -400 * log10(1 / score - 1);
+}
+
+static double expected_score(double elo) {
+    return 1 / (1 + pow(10, -elo / 400));
+}
+
+// 95% confidence interval half-width
+static double elo_margin(const MatchStats &s) {
+    if(s.games() == 0)
+        return 0;
+    double dev = 1.96 * sqrt(s.variance() / s.games());
+    return (elo(s.mean() + dev) - elo(s.mean() - dev)) / 2;
+}
+
+static double likelihood_of_superiority(const MatchStats &s) {
+    if(s.wins + s.losses == 0)
+        return 0.5;
+    return 0.5 * (1 + erf((s.wins - s.losses) / sqrt(2.0 * (s.wins + s.losses))));
+}
+
+// generalized SPRT log-likelihood ratio, normal approximation of the score
+static double sprt_llr(const MatchStats &s, double elo0, double elo1) {
+    double var = s.variance();
+    if(s.games() == 0 || var <= 0)
+        return 0;
+    double s0 = expected_score(elo0), s1 = expected_score(elo1);
+    return (s1 - s0) * (2*s.mean() - s0 - s1) / (2 * var / s.games());
+}
+
+static bool load_openings(const string &path, vector<string> *openings) {
+    ifstream in(path);
+    if(!in)
+        return false;
+    string line;
+    while(getline(in, line)) {
+        // EPD operations follow the first four fields
+        istringstream fields(line);
+        string fen, field;
+        int n;
+        for(n = 0; n < 4 && fields >> field; ++n)
+            fen += (n ? " " : "") + field;
+        if(n == 4)
+            openings->push_back(fen + " 0 1");
+    }
+    return true;
+}
+
+static void set_options(SAkuna &engine, const vector<pair<string, string>> &options) {
+    engine.set_option("Hash", "16");
+    for(const auto &opt : options)
+        engine.set_option(opt.first, opt.second);
+}
+
+int play_game(SAkuna *engines[2], const Board &start, int nodes, int movetime) {
+    for(int p = 0; p < 2; ++p) {
+        engines[p]->new_game();
+        engines[p]->set_position(start);
+    }
+    Move moveList[MAX_MOVES];
+    int winning = 0, drawn = 0;
+    for(int ply = 0; ply < MAX_GAME_PLIES; ++ply) {
+        Board b = engines[0]->position();
+        if(b.moves(moveList) == moveList)
+            return b.in_check(b.player) ? (b.player ? 1 : -1) : 0;
+        if(b.halfmove_clock >= 100)
+            return 0;
+        pair<Move, double> best = engines[b.player]->search_nodes(nodes, movetime);
+        // adjudicate, from white's point of view
+        double white = b.player ? -best.second : best.second;
+        if(abs(white) >= RESIGN_SCORE) {
+            int side = white > 0 ? 1 : -1;
+            winning = winning * side > 0 ? winning + side : side;
+            if(abs(winning) >= RESIGN_PLIES)
+                return side;
+        } else {
+            winning = 0;
+        }
+        drawn = ply >= DRAW_MIN_PLY && abs(white) <= DRAW_SCORE ? drawn + 1 : 0;
+        if(drawn >= DRAW_PLIES)
+            return 0;
+        int occurrences = 0;
+        for(int p = 0; p < 2; ++p)
+            occurrences = engines[p]->play(best.first);
+        if(occurrences >= 3)
+            return 0;
+    }
+    return 0;
+}
+
+struct Match {
+    const MatchConfig &cfg;
+    atomic<int> next_game{0};
+    atomic<bool> decided{false};
+    mutex stats_mutex;
+    MatchStats stats;
+    Match(const MatchConfig &c) : cfg(c) {}
+
+    void report(bool final_report) {
+        double llr = sprt_llr(stats, cfg.elo0, cfg.elo1);
+        printf("%s %d: +%d =%d -%d elo %.1f +- %.1f los %.1f%% llr %.2f (%.2f, %.2f)\n",
+                final_report ? "Final" : "Games", stats.games(), stats.wins, stats.draws,
+                stats.losses, elo(stats.mean()), elo_margin(stats),
+                100 * likelihood_of_superiority(stats), llr,
+                log(cfg.beta / (1 - cfg.alpha)), log((1 - cfg.beta) / cfg.alpha));
+        fflush(stdout);
+    }
+
+    // result from A's point of view
+    void add_result(int result) {
+        lock_guard<mutex> lock(stats_mutex);
+        if(result > 0) ++stats.wins;
+        else if(result < 0) ++stats.losses;
+        else ++stats.draws;
+        report(false);
+        double llr = sprt_llr(stats, cfg.elo0, cfg.elo1);
+        if(llr <= log(cfg.beta / (1 - cfg.alpha)) || llr >= log((1 - cfg.beta) / cfg.alpha))
+            decided = true;
+    }
+
+    void worker() {
+        uci u;
+        SAkuna a(u), b(u);
+        a.set_verbose(false);
+        b.set_verbose(false);
+        set_options(a, cfg.options[0]);
+        set_options(b, cfg.options[1]);
+        const Board start_position(u.start_fen, {});
+        int game;
+        while(!decided && (game = next_game++) < cfg.games) {
+            // the two games of a pair share their opening with swapped colors
+            int pair = game / 2;
+            Board start;
+            if(cfg.openings.empty()) {
+                mt19937_64 rng(pair);
+                a.new_game();
+                random_opening(a, start_position, cfg.random_plies, rng);
+                start = a.position();
+            } else {
+                start = Board(cfg.openings[pair % cfg.openings.size()], {});
+            }
+            bool a_white = game % 2 == 0;
+            SAkuna *engines[2] = {a_white ? &a : &b, a_white ? &b : &a};
+            int result = play_game(engines, start, cfg.nodes, cfg.movetime);
+            add_result(a_white ? result : -result);
+        }
+    }
+};
+
+int match(int argc, char **argv) {
+    MatchConfig cfg;
+    for(int i = 0; i < argc; ++i) {
+        string arg = argv[i];
+        size_t eq = arg.find('=');
+        if(arg.size() > 2 && (arg[0] == 'A' || arg[0] == 'B') && arg[1] == '.'
+                && eq != string::npos) {
+            // search_nodes only runs the main thread: helpers would stay idle
+            if(arg.substr(2, eq - 2) == "Threads") {
+                fprintf(stderr, "match: Threads is not supported, use concurrency\n");
+                return 1;
+            }
+            cfg.options[arg[0] - 'A'].emplace_back(arg.substr(2, eq - 2), arg.substr(eq + 1));
+            continue;
+        }
+        if(i + 1 >= argc) {
+            fprintf(stderr, "match: missing value for %s\n", argv[i]);
+            return 1;
+        }
+        string value = argv[++i];
+        if(arg == "games") cfg.games = atoi(value.c_str());
+        else if(arg == "concurrency") cfg.concurrency = max(1, atoi(value.c_str()));
+        else if(arg == "nodes") cfg.nodes = max(0, atoi(value.c_str()));
+        else if(arg == "movetime") cfg.movetime = max(0, atoi(value.c_str()));
+        else if(arg == "random") cfg.random_plies = atoi(value.c_str());
+        else if(arg == "elo0") cfg.elo0 = atof(value.c_str());
+        else if(arg == "elo1") cfg.elo1 = atof(value.c_str());
+        else if(arg == "alpha") cfg.alpha = atof(value.c_str());
+        else if(arg == "beta") cfg.beta = atof(value.c_str());
+        else if(arg == "openings") {
+            if(!load_openings(value, &cfg.openings) || cfg.openings.empty()) {
+                fprintf(stderr, "match: no openings in %s\n", value.c_str());
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "match: unknown option %s\n", arg.c_str());
+            return 1;
+        }
+    }
+    if(cfg.nodes == 0 && cfg.movetime == 0)
+        cfg.nodes = 5000;
+    printf("match: %d games, concurrency %d, %s %d, sprt elo0 %.1f elo1 %.1f\n",
+            cfg.games, cfg.concurrency, cfg.nodes ? "nodes" : "movetime",
+            cfg.nodes ? cfg.nodes : cfg.movetime, cfg.elo0, cfg.elo1);
+    fflush(stdout);
+    Match m(cfg);
+    vector<thread> threads;
+    for(int i = 0; i < cfg.concurrency; ++i)
+        threads.emplace_back(&Match::worker, &m);
+    for(thread &t : threads)
+        t.join();
+    m.report(true);
+    double llr = sprt_llr(m.stats, cfg.elo0, cfg.elo1);
+    if(llr >= log((1 - cfg.beta) / cfg.alpha))
+        printf("H1 accepted: A is stronger by at least %.1f elo\n", cfg.elo0);
+    else if(llr <= log(cfg.beta / (1 - cfg.alpha)))
+        printf("H0 accepted: A is not stronger by %.1f elo\n", cfg.elo1);
+    else
+        printf("No decision\n");
+    return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef MATCH_HPP_
+#define MATCH_HPP_
+
+class Board;
+class SAkuna;
+
+// Play one game between white and black from start, each move searched with
+// search_nodes, and return the result for white. Lost and dead drawn games
+// are adjudicated on the scores of the engines.
+int play_game(SAkuna *engines[2], const Board &start, int nodes, int movetime);
+
+// SAkuna match [games N] [concurrency N] [nodes N] [movetime MS] [openings FILE]
+//              [random N] [elo0 X] [elo1 X] [alpha X] [beta X]
+//              [A.Option=value]... [B.Option=value]...
+// Plays the two configurations against each other, each opening with both
+// colors, and stops early once the SPRT of elo1 against elo0 is decided.
+int match(int argc, char **argv);
+
+#endif
@@ -2,7 +2,7 @@
 
 using namespace std;
 
-string Move::toString() {
+string Move::toString() const {
     string ans = "";
     ans += c0+'a';
     ans += r0+'1';
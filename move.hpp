@@ -15,7 +15,7 @@ struct Move {
         {}
     Move(int r0, int c0, int r1, int c1) : r0(r0), c0(c0), r1(r1), c1(c1), p(0)
         {}
-    std::string toString();
+    std::string toString() const;
     bool operator == (const Move&) const;
 };
 
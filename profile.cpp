@@ -0,0 +1,68 @@
+#include "profile.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+static const char *ZONE_NAMES[NB_ZONES] = {
+    "moves", "legal", "do_move", "init", "eval", "tt_probe", "tt_store"
+};
+
+// counters of the running threads, and the sums of the finished ones
+static mutex registry_mutex;
+static vector<ProfileCounter*> registry;
+static ProfileCounter retired[NB_ZONES];
+
+struct ThreadCounters {
+    ProfileCounter zones[NB_ZONES];
+    ThreadCounters() : zones() {
+        lock_guard<mutex> lock(registry_mutex);
+        registry.push_back(zones);
+    }
+    ~ThreadCounters() {
+        lock_guard<mutex> lock(registry_mutex);
+        registry.erase(find(registry.begin(), registry.end(), zones));
+        for(int z = 0; z < NB_ZONES; ++z) {
+            retired[z].calls += zones[z].calls;
+            retired[z].samples += zones[z].samples;
+            retired[z].cycles += zones[z].cycles;
+        }
+    }
+};
+
+ProfileCounter* profile_counters() {
+    static thread_local ThreadCounters counters;
+    return counters.zones;
+}
+
+void profile_reset() {
+    lock_guard<mutex> lock(registry_mutex);
+    for(ProfileCounter *zones : registry)
+        memset(zones, 0, NB_ZONES * sizeof(ProfileCounter));
+    memset(retired, 0, sizeof retired);
+}
+
+void profile_report() {
+    ProfileCounter total[NB_ZONES];
+    {
+        lock_guard<mutex> lock(registry_mutex);
+        memcpy(total, retired, sizeof total);
+        for(ProfileCounter *zones : registry)
+            for(int z = 0; z < NB_ZONES; ++z) {
+                total[z].calls += zones[z].calls;
+                total[z].samples += zones[z].samples;
+                total[z].cycles += zones[z].cycles;
+            }
+    }
+    printf("info string profile %-9s %12s %16s %10s\n", "zone", "calls", "cycles", "per call");
+    for(int z = 0; z < NB_ZONES; ++z) {
+        double per_call = (double)total[z].cycles / max<uint64_t>(total[z].samples, 1);
+        printf("info string profile %-9s %12llu %16.0f %10.1f\n", ZONE_NAMES[z],
+                (unsigned long long)total[z].calls, per_call * total[z].calls, per_call);
+    }
+    fflush(stdout);
+}
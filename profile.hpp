@@ -0,0 +1,54 @@
+#ifndef PROFILE_HPP_
+#define PROFILE_HPP_
+
+#include <cstdint>
+
+#include <x86intrin.h>
+
+// Cycle counters of the search hot paths, compiled in with make PROFILE=1.
+// Every call is counted but only one in PROFILE_SAMPLING is timed, the
+// totals are extrapolated from the timed calls. The zones nest (moves calls
+// init and legal), their cycles are inclusive.
+#ifndef PROFILE
+#define PROFILE 0
+#endif
+
+enum ProfileZone {
+    ZONE_MOVES, ZONE_LEGAL, ZONE_DO_MOVE, ZONE_INIT, ZONE_EVAL,
+    ZONE_TT_PROBE, ZONE_TT_STORE, NB_ZONES
+};
+
+const uint64_t PROFILE_SAMPLING = 16;
+
+struct ProfileCounter {
+    uint64_t calls, samples, cycles;
+};
+
+// counters of the calling thread
+ProfileCounter* profile_counters();
+// zero the counters of every thread
+void profile_reset();
+// print the breakdown of every thread's counters as info strings
+void profile_report();
+
+class ProfileScope {
+    ProfileCounter &counter;
+    uint64_t start;
+    public:
+    ProfileScope(ProfileZone zone) : counter(profile_counters()[zone]),
+            start(++counter.calls % PROFILE_SAMPLING ? 0 : __rdtsc()) {}
+    ~ProfileScope() {
+        if(start) {
+            counter.cycles += __rdtsc() - start;
+            ++counter.samples;
+        }
+    }
+};
+
+#if PROFILE
+#define PROFILE_SCOPE(zone) ProfileScope profile_scope(zone)
+#else
+#define PROFILE_SCOPE(zone) ((void)0)
+#endif
+
+#endif
@@ -3,33 +3,246 @@
 #include <chrono>
 #include <cmath>
 #include <cstdio>
+#include <cstdlib>
 #include <utility>
 
+#include "alloc.hpp"
+#include "book.hpp"
+#include "endgame.hpp"
+#include "profile.hpp"
+#include "system.hpp"
+
 using namespace std;
 
-SAkuna::SAkuna(uci &_u) : u(_u) {
-    initmagicmoves();
-    lookup_table_init();
+const SearchParams default_search_params = {
+    100, // reverse_futility_margin
+    150, // futility_margin
+    300, // razor_margin
+    3,   // late_move_base
+    6,   // singular_depth
+    8,   // singular_margin
+};
+
+#define SEARCH_PARAM(name, field, min, max, step) {name, min, max, step, false, \
+    [] (const SearchParams &s, const EvalParams&) { return (int)s.field; }, \
+    [] (SearchParams &s, EvalParams&, int v) { s.field = v; }}
+#define EVAL_PARAM(name, field, min, max, step) {name, min, max, step, true, \
+    [] (const SearchParams&, const EvalParams &e) { return (int)e.field; }, \
+    [] (SearchParams&, EvalParams &e, int v) { e.field = v; }}
+
+const TunableParam tunable_params[NB_TUNABLE_PARAMS] = {
+    SEARCH_PARAM("ReverseFutilityMargin", reverse_futility_margin, 0, 1000, 10),
+    SEARCH_PARAM("FutilityMargin", futility_margin, 0, 1000, 10),
+    SEARCH_PARAM("RazorMargin", razor_margin, 0, 2000, 20),
+    SEARCH_PARAM("LateMoveBase", late_move_base, 0, 256, 1),
+    SEARCH_PARAM("SingularDepth", singular_depth, 1, 64, 1),
+    SEARCH_PARAM("SingularMargin", singular_margin, 0, 1000, 2),
+    EVAL_PARAM("KnightValue", values[pt_knight], 0, 2000, 10),
+    EVAL_PARAM("BishopValue", values[pt_bishop], 0, 2000, 10),
+    EVAL_PARAM("RookValue", values[pt_rook], 0, 3000, 15),
+    EVAL_PARAM("QueenValue", values[pt_queen], 0, 5000, 25),
+};
+
+#undef SEARCH_PARAM
+#undef EVAL_PARAM
+
+SAkuna::SAkuna(uci &_u, SAkuna *main_engine) : u(_u), params(eval_params),
+        search_params(default_search_params), stats(), eval_cache(EVAL_CACHE_SIZE),
+        transposition(main_engine ? main_engine->transposition : own_transposition),
+        experience(main_engine ? main_engine->experience : own_experience),
+        root_history(&history), allocations(0), last_nodes(0), multi_pv(1), hash_size(64), large_pages(true), hash_dirty(main_engine == nullptr),
+        experience_size(64), experience_depth(8), experience_dirty(false),
+        verbose(true), node_limit(0), time_limited(false),
+        nb_threads(1), stop(false),
+        stop_flag(main_engine ? &main_engine->stop : &stop),
+        search_id(0), nb_running(0), quit_helpers(false) {
+    root_excluded.reserve(MAX_MULTI_PV);
+    fill(excluded, excluded + MAX_PLY+1, Move(-1, -1, -1, -1));
 }
 
 void SAkuna::init() {
-    srand(42);
+    allocate_hash();
+    endgame_init();
+}
+
+void SAkuna::allocate_hash() {
+    allocate_experience();
+    if(!hash_dirty) return;
+    hash_dirty = false;
+    // halve the table until its memory can be obtained
+    size_t mb = hash_size;
+    while(!transposition.resize(mb, shared_hash, large_pages) && mb > 1)
+        mb /= 2;
+    if(!transposition.is_allocated()) {
+        printf("info string cannot allocate the hash table\n");
+        fflush(stdout);
+        exit(EXIT_FAILURE);
+    }
+    if(!shared_hash.empty() && !transposition.is_shared())
+        printf("info string cannot attach shared hash %s, using a private table\n",
+                shared_hash.c_str());
+    if(mb < hash_size)
+        printf("info string cannot allocate %zu MB of hash, using %zu MB\n", hash_size, mb);
+    if(!verbose) return;
+    printf("info string hash %zu MB on %s, %d NUMA node(s)\n", mb,
+            transposition.allocation.c_str(), numa_nodes());
+    fflush(stdout);
+}
+
+void SAkuna::allocate_experience() {
+    if(!experience_dirty) return;
+    experience_dirty = false;
+    if(!experience.open_file(experience_size, experience_file) && !experience_file.empty())
+        printf("info string cannot open experience file %s\n", experience_file.c_str());
+    else if(verbose && !experience_file.empty())
+        printf("info string experience on %s\n", experience.allocation.c_str());
+    fflush(stdout);
+}
+
+bool SAkuna::probe(uint64_t key, TTData *ttData) {
+    ++tt_probes;
+    if(!transposition.probe(key, ttData))
+        return false;
+    ++tt_hits;
+    tt_shared_hits += ttData->foreign;
+    return true;
+}
+
+void SAkuna::start_helpers() {
+    helpers.assign(nb_threads-1, nullptr);
+    bind_thread(0);
+    for(int i = 1; i < nb_threads; ++i)
+        helper_threads.emplace_back(&SAkuna::helper_loop, this, i);
+    unique_lock<mutex> lock(helper_mutex);
+    helper_cv.wait(lock, [&] () {
+        return count(helpers.begin(), helpers.end(), nullptr) == 0;
+    });
+}
+
+void SAkuna::stop_helpers() {
+    {
+        lock_guard<mutex> lock(helper_mutex);
+        quit_helpers = true;
+    }
+    helper_cv.notify_all();
+    for(auto &thread : helper_threads)
+        thread.join();
+    helper_threads.clear();
+    helpers.clear();
+    quit_helpers = false;
 }
 
+void SAkuna::helper_loop(int idx) {
+    bind_thread(idx);
+    // built from its own thread, so that its data lives on its NUMA node
+    SAkuna helper(u, this);
+    unique_lock<mutex> lock(helper_mutex);
+    helpers[idx-1] = &helper;
+    helper_cv.notify_all();
+    int seen = search_id;
+    while(true) {
+        helper_cv.wait(lock, [&] () {
+            return quit_helpers || search_id != seen;
+        });
+        if(quit_helpers) break;
+        seen = search_id;
+        lock.unlock();
+        helper.helper_search(idx);
+        lock.lock();
+        if(--nb_running == 0)
+            helper_cv.notify_all();
+    }
+}
+
+void SAkuna::new_game() {
+    transposition.clear();
+    clear_eval_cache();
+}
+
+void SAkuna::clear_eval_cache() {
+    fill(eval_cache.begin(), eval_cache.end(), EvalEntry{0, 0});
+}
+
+void SAkuna::set_option(const string& name, const string& value) {
+    if(name == "Hash") {
+        hash_size = atoi(value.c_str());
+        hash_dirty = true;
+    } else if(name == "SharedHash") {
+        shared_hash = value == "<empty>" ? "" : value;
+        hash_dirty = true;
+    } else if(name == "LargePages") {
+        large_pages = value == "true";
+        hash_dirty = true;
+    } else if(name == "ExperienceFile") {
+        experience_file = value == "<empty>" ? "" : value;
+        experience_dirty = true;
+    } else if(name == "ExperienceSize") {
+        experience_size = atoi(value.c_str());
+        experience_dirty = true;
+    } else if(name == "ExperienceDepth") {
+        experience_depth = max(1, atoi(value.c_str()));
+    } else if(name == "EvalFile") {
+        if(value == "<empty>")
+            params = eval_params;
+        else if(!load_eval_params(value, &params))
+            printf("info string cannot load eval parameters from %s\n", value.c_str());
+        // the helpers get the new parameters with the next search
+        clear_eval_cache();
+        for(SAkuna *helper : helpers)
+            helper->clear_eval_cache();
+        material_params_changed();
+    } else if(name == "MultiPV") {
+        multi_pv = max(1, min(MAX_MULTI_PV, atoi(value.c_str())));
+    } else if(name == "Threads") {
+        stop_helpers();
+        nb_threads = max(1, atoi(value.c_str()));
+        start_helpers();
+    } else {
+        for(const TunableParam &t : tunable_params) {
+            if(name != t.name) continue;
+            t.set(search_params, params, atoi(value.c_str()));
+            if(!t.eval) continue;
+            clear_eval_cache();
+            for(SAkuna *helper : helpers)
+                helper->clear_eval_cache();
+            material_params_changed();
+        }
+    }
+}
+
+const int MAX_MOVES = 256;
+// plies from the root where the experience file is probed
+const int EXPERIENCE_PLIES = 2;
+
 void SAkuna::set_position(const string& fen, const vector<string>& moves) {
     fprintf(stderr, "%d => %s\n", (int)moves.size(), fen.c_str());
-    repetition.clear();
-    vector<string> sub_moves;
-    for(int i = 0; i <= (int)moves.size(); ++i) {
-        board = Board(fen, sub_moves);
-        if(repetition.count(board) == 0)
-            repetition[board] = 0;
-        ++repetition[board];
-        if(i < (int)moves.size())
-            sub_moves.push_back(moves[i]);
+    set_position(Board(fen, {}));
+    Move moveList[MAX_MOVES];
+    for(const string &move : moves) {
+        Move *endMoves = board.moves(moveList);
+        Move *m = find_if(moveList, endMoves, [&] (Move &m) { return m.toString() == move; });
+        if(m == endMoves) {
+            printf("info string illegal move %s\n", move.c_str());
+            break;
+        }
+        play(*m);
     }
 }
 
+void SAkuna::set_position(const Board& b) {
+    board = b;
+    history.assign(1, board.key);
+}
+
+// returns the number of occurrences of the new position
+int SAkuna::play(Move move) {
+    Board newBd;
+    board.do_move(move, &newBd);
+    board = newBd;
+    history.push_back(board.key);
+    return count(history.begin(), history.end(), board.key);
+}
+
 // check if player is in check
 bool SAkuna::valid(Move move) {
     Board newBd;
@@ -37,138 +250,632 @@ bool SAkuna::valid(Move move) {
     return !newBd.in_check(board.player);
 }
 
-const int MAX_MOVES = 256;
+const double MATE_SCORE = 1'000'000'000LL;
 
-pair<Move, double> SAkuna::alphabeta(Board board, int max_depth, int depth=0, double alpha=-numeric_limits<double>::infinity(), double beta=numeric_limits<double>::infinity()) {
+// mate scores are relative to the root in the search and to the node in the
+// transposition table
+static double score_to_tt(double score, int depth) {
+    if(abs(score) < MATE_SCORE) return score;
+    return score > 0 ? score - depth * MATE_SCORE : score + depth * MATE_SCORE;
+}
+
+static double score_from_tt(double score, int depth) {
+    if(abs(score) < MATE_SCORE) return score;
+    return score > 0 ? score + depth * MATE_SCORE : score - depth * MATE_SCORE;
+}
+
+// occurrences of the position at this ply in the searched line and the game,
+// among the positions since the last irreversible move
+int SAkuna::repetitions(int depth, int halfmove_clock) const {
+    const vector<uint64_t> &game = *root_history;
+    int first = max(depth - halfmove_clock, 1 - (int)game.size());
+    int count = 0;
+    for(int i = depth; i >= first; i -= 2)
+        count += (i >= 0 ? path[i] : game[game.size()-1+i]) == path[depth];
+    return count;
+}
+
+// counts a leaf, and stops the search at the node or time limit
+inline void SAkuna::count_leaf() {
+    if(++nb_states == node_limit)
+        *stop_flag = true;
+    if(time_limited && (nb_states & 1023) == 0
+            && chrono::steady_clock::now() >= deadline)
+        *stop_flag = true;
+}
+
+inline double SAkuna::evaluate(const Board &board) {
+    EvalEntry &entry = eval_cache[board.key & (EVAL_CACHE_SIZE-1)];
+    uint32_t check = board.key >> 32;
+    STAT_INC(stats, eval_probes);
+    if(entry.key == check) {
+        STAT_INC(stats, eval_hits);
+        return entry.score;
+    }
+    entry = {check, board.eval(params)};
+    return entry.score;
+}
+
+inline void SAkuna::prefetch_eval(uint64_t key) const {
+    __builtin_prefetch(&eval_cache[key & (EVAL_CACHE_SIZE-1)]);
+}
+
+// captures only, most valuable victim first then least valuable attacker
+double SAkuna::quiesce(Board &board, double alpha, double beta) {
+    count_leaf();
+    STAT_INC(stats, quiescence);
+    double best = evaluate(board);
+    if(best >= beta)
+        return best;
+    alpha = max(alpha, best);
     Move moveList[MAX_MOVES];
     Move *endMoves = board.moves(moveList);
+    pair<int, Move*> captures[MAX_MOVES];
+    int nb_captures = 0;
+    for(Move *m = moveList; m < endMoves; ++m) {
+        Piece_Type victim = board.piece_on(Square(8*m->r1 + m->c1));
+        if(victim == pt_empty && m->p == 0)
+            continue;
+        captures[nb_captures++] = {8*victim - board.piece_on(Square(8*m->r0 + m->c0)), m};
+    }
+    sort(captures, captures + nb_captures, [] (const pair<int, Move*> &a, const pair<int, Move*> &b) {
+        return a.first > b.first;
+    });
+    Board newBd;
+    for(int i = 0; i < nb_captures && !*stop_flag; ++i) {
+        board.do_move(*captures[i].second, &newBd);
+        best = max(best, -quiesce(newBd, -beta, -alpha));
+        alpha = max(alpha, best);
+        if(alpha >= beta)
+            break;
+    }
+    return best;
+}
+
+pair<Move, double> SAkuna::alphabeta(Board board, int max_depth, int depth=0, double alpha=-numeric_limits<double>::infinity(), double beta=numeric_limits<double>::infinity()) {
+    pv_length[depth] = depth;
+    path[depth] = board.key;
+    if(depth == 0)
+        root_depth = max_depth;
+    if(*stop_flag)
+        return {Move(-1, -1, -1, -1), 0};
+    // the leaves only look for a legal move, to score mates and stalemates
+    Move moveList[MAX_MOVES];
+    Move *endMoves = depth < max_depth ? board.moves(moveList) : moveList;
     int nbMoves = endMoves - moveList;
-    if(nbMoves == 0) {
+    if(depth < max_depth ? nbMoves == 0 : !board.has_legal_move()) {
         return {Move(-1, -1, -1, -1), board.in_check(board.player) ? (depth+1) * -1'000'000'000LL : 0};
     }
-    if(board.halfmove_clock == 50)
-        return {Move(-1, -1, -1, -1), 0};
-    if(repetition.count(board) && repetition[board] > 2)
+    // the root always returns a move
+    if(depth > 0 && (board.halfmove_clock >= 100 || repetitions(depth, board.halfmove_clock) > 2))
         return {Move(-1, -1, -1, -1), 0};
     if(depth == max_depth) {
-        ++nb_states;
-        return {Move(-1,-1,-1,-1), board.eval()};
+        count_leaf();
+        return {Move(-1,-1,-1,-1), evaluate(board)};
     }
-    if(transposition.count(board) && transposition[board].first >= max_depth-depth) {
-        return transposition[board].second;
+    STAT_INC(stats, interior);
+    double alphaOrig = alpha;
+    // searched without one of its moves, to test that move's singularity
+    bool excluding = excluded[depth].r0 != -1;
+    TTData ttData;
+    bool ttHit = probe(board.key, &ttData);
+    // near the root, a deeper result of an earlier run is copied to the table
+    TTData expData;
+    if(depth <= EXPERIENCE_PLIES && experience.is_allocated()
+            && experience.probe(board.key, &expData)
+            && (!ttHit || expData.depth > ttData.depth)) {
+        transposition.store(board.key, expData.depth, expData.bound, expData.score, expData.move);
+        ttData = expData;
+        ttHit = true;
     }
-    vector<pair<double, int>> moves(endMoves-moveList);
+    if(ttHit) {
+        ttData.score = score_from_tt(ttData.score, depth);
+        // only reuse results whose horizon has the same parity as ours, and
+        // always search the root to get its principal variation
+        if(depth > 0 && !excluding && ttData.depth >= max_depth-depth
+                && (ttData.depth - (max_depth-depth)) % 2 == 0
+                && (ttData.bound == BOUND_EXACT
+                    || (ttData.bound == BOUND_LOWER && ttData.score >= beta)
+                    || (ttData.bound == BOUND_UPPER && ttData.score <= alpha))) {
+            if(ttData.bound == BOUND_EXACT && ttData.move.r0 != -1) {
+                pv[depth][depth] = ttData.move;
+                pv_length[depth] = depth+1;
+            }
+            STAT_INC(stats, tt_cutoffs);
+            return {ttData.move, ttData.score};
+        }
+    }
+    // selective search near the horizon, never in check nor with mate bounds
+    const SearchParams &sp = search_params;
+    int remaining = max_depth - depth;
+    bool frontier = depth > 0 && remaining <= FRONTIER_DEPTH && !board.in_check(board.player);
+    double static_eval = frontier ? evaluate(board) : 0;
+    if(frontier && abs(beta) < MATE_SCORE
+            && static_eval - sp.reverse_futility_margin * remaining >= beta) {
+        STAT_INC(stats, reverse_futility_cutoffs);
+        return {Move(-1, -1, -1, -1), static_eval};
+    }
+    if(frontier && remaining <= 2 && abs(alpha) < MATE_SCORE
+            && static_eval + sp.razor_margin * remaining <= alpha) {
+        double score = quiesce(board, alpha, beta);
+        if(score <= alpha) {
+            STAT_INC(stats, razor_cutoffs);
+            return {Move(-1, -1, -1, -1), score};
+        }
+    }
+    bool futile = frontier && abs(alpha) < MATE_SCORE
+        && static_eval + sp.futility_margin * remaining <= alpha;
+    int late_moves = sp.late_move_base + remaining * remaining, nb_quiets = 0;
+    pair<double, int> moves[MAX_MOVES];
     Board newBd;
     bool skipFirst = false;
-    if(transposition.count(board) && transposition[board].second.first.r0 != -1) {
+    if(ttHit && ttData.move.r0 != -1) {
         for(int i = 0; i < endMoves-moveList; ++i) {
-            if(moveList[i] == transposition[board].second.first) {
+            if(moveList[i] == ttData.move) {
                 swap(moveList[0], moveList[i]);
                 skipFirst = true;
                 break;
             }
         }
     }
+    /* Singular extension: when every other move fails low against a margin
+        below the TT move's score, at reduced depth, the TT move is extended.
+        When that search fails high beyond beta instead, several moves beat
+        beta and the node is cut (multi-cut). */
+    bool extend_tt_move = false;
+    if(depth > 0 && !excluding && skipFirst && remaining >= sp.singular_depth
+            && max_depth == root_depth && max_depth+2 < MAX_PLY && ttData.bound != BOUND_UPPER
+            && ttData.depth >= remaining-3 && abs(ttData.score) < MATE_SCORE) {
+        double singular_beta = ttData.score - sp.singular_margin * remaining;
+        excluded[depth] = ttData.move;
+        double score = alphabeta(board, depth + remaining/2, depth, singular_beta-1, singular_beta).second;
+        excluded[depth] = Move(-1, -1, -1, -1);
+        pv_length[depth] = depth;
+        if(*stop_flag)
+            return {Move(-1, -1, -1, -1), 0};
+        if(score < singular_beta) {
+            STAT_INC(stats, singular_extensions);
+            extend_tt_move = true;
+        } else if(singular_beta >= beta) {
+            STAT_INC(stats, multi_cuts);
+            return {ttData.move, singular_beta};
+        }
+    }
     if(depth == max_depth-1) {
-        random_shuffle(moveList+skipFirst, endMoves);
         for(int i = 0; i < endMoves-moveList; ++i) {
             moves[i] = {0, i};
         }
     } else {
         for(int i = 1; i < endMoves-moveList; ++i) {
+            uint64_t key = board.key_after(moveList[i]);
+            transposition.prefetch(key);
+            prefetch_eval(key);
             board.do_move(moveList[i], &newBd);
-            if(transposition.count(newBd) == 0)
-                transposition[newBd] = {0, {Move(-1, -1, -1, -1), newBd.eval()}};
-            moves[i] = {transposition[newBd].second.second, i};
+            TTData childData;
+            if(!probe(newBd.key, &childData)) {
+                childData.score = evaluate(newBd);
+                transposition.store(newBd.key, 0, BOUND_EXACT, childData.score, Move(-1, -1, -1, -1));
+            }
+            moves[i] = {childData.score, i};
         }
-        sort(moves.begin()+skipFirst, moves.end(), [] (const pair<double, int> &a, const pair<double, int> &b) -> bool {
+        sort(moves+skipFirst, moves+nbMoves, [] (const pair<double, int> &a, const pair<double, int> &b) -> bool {
                 return a.first < b.first;
         });
     }
     Move *bestMove = moveList;
     double bestScore = -numeric_limits<double>::infinity();
-    for(auto m : moves) {
-        board.do_move(moveList[m.second], &newBd);
-        if(repetition.count(newBd) == 0)
-            repetition[newBd] = 0;
-        ++repetition[newBd];
-        double score = -alphabeta(newBd, max_depth, depth+1, -beta, -alpha).second;
-        --repetition[newBd];
+    for(int i = 0; i < nbMoves; ++i) {
+        pair<double, int> m = moves[i];
+        if(depth == 0 && find(root_excluded.begin(), root_excluded.end(),
+                    moveList[m.second]) != root_excluded.end())
+            continue;
+        const Move &move = moveList[m.second];
+        if(excluding && move == excluded[depth])
+            continue;
+        bool quiet = move.p == 0 && board.piece_on(Square(8*move.r1 + move.c1)) == pt_empty;
+        // keep at least one searched move, and the checks
+        if(frontier && quiet && bestScore > -numeric_limits<double>::infinity()
+                && !board.gives_check(move)) {
+            if(futile) {
+                STAT_INC(stats, futility_pruned);
+                continue;
+            }
+            if(++nb_quiets > late_moves) {
+                STAT_INC(stats, late_move_pruned);
+                continue;
+            }
+        }
+        uint64_t key = board.key_after(move);
+        transposition.prefetch(key);
+        prefetch_eval(key);
+        board.do_move(move, &newBd);
+        // by two plies, to keep the horizon on the same side to move
+        int child_max_depth = max_depth + 2*(extend_tt_move && m.second == 0);
+        double score = -alphabeta(newBd, child_max_depth, depth+1, -beta, -alpha).second;
+        // the result of an aborted search is not stored
+        if(*stop_flag)
+            return {*bestMove, bestScore};
         if(score > bestScore) {
             bestScore = score;
             bestMove = &moveList[m.second];
+            if(score > alpha) {
+                pv[depth][depth] = *bestMove;
+                for(int i = depth+1; i < pv_length[depth+1]; ++i)
+                    pv[depth][i] = pv[depth+1][i];
+                pv_length[depth] = max(pv_length[depth+1], depth+1);
+            }
         }
         alpha = max(alpha, bestScore);
-        if(alpha >= beta)
+        if(alpha >= beta) {
+            STAT_INC(stats, beta_cutoffs);
+            STAT_ADD(stats, first_move_cutoffs, i == 0);
             break;
+        }
     }
-    transposition[board] = {max_depth-depth, {*bestMove, bestScore}};
+    Bound bound = bestScore <= alphaOrig ? BOUND_UPPER
+        : bestScore >= beta ? BOUND_LOWER : BOUND_EXACT;
+    // the score of a node without some of its moves is not the position's,
+    // nor is the score of an aborted search
+    if(excluding || (depth == 0 && !root_excluded.empty()) || *stop_flag)
+        return {*bestMove, bestScore};
+    transposition.store(board.key, max_depth-depth, bound, score_to_tt(bestScore, depth), *bestMove);
+    // the file outlives the process: only completed searches reach it
+    if(max_depth-depth >= experience_depth && experience.is_allocated() && !*stop_flag)
+        experience.store(board.key, max_depth-depth, bound, score_to_tt(bestScore, depth), *bestMove);
     return {*bestMove, bestScore};
 }
 
-void SAkuna::start_search(int wtime, int btime) {
-    transposition.clear();
-    pair<Move, double> bestResult =
-        {Move(-1, -1, -1, -1), -numeric_limits<double>::infinity()};
+void SAkuna::helper_search(int idx) {
+    nb_states = 0;
+    stats.clear();
+    tt_probes = tt_hits = tt_shared_hits = 0;
+    // half of the helpers search one iteration ahead of the main thread
+    for(int max_depth = 2 + 2*(idx%2); max_depth < MAX_PLY && !*stop_flag; max_depth += 2)
+        alphabeta(board, max_depth);
+}
+
+// Iterative deepening until the given number of leaves, milliseconds or
+// plies (0 for no limit), without output. The first iteration always
+// completes; on_iteration is given the depth and best move of each one.
+pair<Move, double> SAkuna::search_nodes(int nodes, int movetime, int depth,
+        const function<void(int, Move)> &on_iteration) {
+    allocate_hash();
+    transposition.new_search();
+    stop = false;
+    nb_states = 0;
+    stats.clear();
+    auto start_time = chrono::steady_clock::now();
+    pair<Move, double> best = alphabeta(board, 2);
+    if(on_iteration)
+        on_iteration(2, best.first);
+    node_limit = nodes;
+    time_limited = movetime > 0;
+    deadline = start_time + chrono::milliseconds(movetime);
+    for(int max_depth = 4; max_depth < MAX_PLY && (!depth || max_depth <= depth)
+            && (!nodes || nb_states < nodes); max_depth += 2) {
+        pair<Move, double> result = alphabeta(board, max_depth);
+        if(stop) break;
+        best = result;
+        if(on_iteration)
+            on_iteration(max_depth, best.first);
+    }
+    last_nodes = nb_states;
+    node_limit = 0;
+    time_limited = false;
+    stop = false;
+    return best;
+}
+
+void SAkuna::print_info(int depth, int index, int nodes, int64_t ns, const Line& line) {
+    double score = line.score;
+    printf("info depth %d", depth);
+    if(multi_pv > 1)
+        printf(" multipv %d", index);
+    if(abs(score) < MATE_SCORE)
+        printf(" score cp %lld", (long long int)score);
+    else
+        printf(" score mate %lld", ((long long int)score / 1'000'000'000 + 1 + (board.player ? 1 : 0))/2);
+    printf(" nodes %d nps %d pv", nodes, (int)((double)nodes / ns * 1'000'000'000));
+    for(int i = 0; i < line.length; ++i)
+        printf(" %s", line.pv[i].toString().c_str());
+    printf("\n");
+}
+
+// Nodes and effective branching factor (per ply, the iterations step by two
+// plies) of the iteration that just finished.
+void SAkuna::record_iteration(int depth) {
+    uint64_t total = stats.interior + nb_states;
+    for(const IterationStats &it : iterations)
+        total -= it.nodes;
+    iterations.push_back({depth, total});
+    if(!verbose)
+        return;
+    printf("info string stats depth %d nodes %llu", depth, (unsigned long long)total);
+    if(iterations.size() > 1)
+        printf(" ebf %.2f", sqrt((double)total / max<uint64_t>(iterations.end()[-2].nodes, 1)));
+    printf("\n");
+}
+
+static double percent(uint64_t a, uint64_t b) {
+    return 100.0 * a / max<uint64_t>(b, 1);
+}
+
+// JSON summary of the last search
+void SAkuna::print_stats() {
+    if(!STATS) {
+        printf("{\"enabled\": false}\n");
+        fflush(stdout);
+        return;
+    }
+    printf("{\"enabled\": true, \"nodes\": %llu, \"interior\": %llu, \"leaves\": %llu, "
+            "\"tt_probes\": %llu, \"tt_hits\": %llu, \"tt_cutoffs\": %llu, "
+            "\"beta_cutoffs\": %llu, \"first_move_cutoff_rate\": %.4f, "
+            "\"aspiration_researches\": %llu, \"quiescence\": %llu, "
+            "\"reverse_futility_cutoffs\": %llu, \"razor_cutoffs\": %llu, "
+            "\"futility_pruned\": %llu, \"late_move_pruned\": %llu, "
+            "\"singular_extensions\": %llu, \"multi_cuts\": %llu, "
+            "\"eval_probes\": %llu, \"eval_hit_rate\": %.4f, \"iterations\": [",
+            (unsigned long long)stats.nodes(), (unsigned long long)stats.interior,
+            (unsigned long long)stats.leaves, (unsigned long long)tt_probes,
+            (unsigned long long)tt_hits, (unsigned long long)stats.tt_cutoffs,
+            (unsigned long long)stats.beta_cutoffs,
+            percent(stats.first_move_cutoffs, stats.beta_cutoffs) / 100,
+            (unsigned long long)stats.aspiration_researches,
+            (unsigned long long)stats.quiescence,
+            (unsigned long long)stats.reverse_futility_cutoffs,
+            (unsigned long long)stats.razor_cutoffs,
+            (unsigned long long)stats.futility_pruned,
+            (unsigned long long)stats.late_move_pruned,
+            (unsigned long long)stats.singular_extensions,
+            (unsigned long long)stats.multi_cuts,
+            (unsigned long long)stats.eval_probes,
+            percent(stats.eval_hits, stats.eval_probes) / 100);
+    for(size_t i = 0; i < iterations.size(); ++i) {
+        printf("%s{\"depth\": %d, \"nodes\": %llu", i ? ", " : "", iterations[i].depth,
+                (unsigned long long)iterations[i].nodes);
+        if(i > 0)
+            printf(", \"ebf\": %.2f", sqrt((double)iterations[i].nodes
+                        / max<uint64_t>(iterations[i-1].nodes, 1)));
+        printf("}");
+    }
+    printf("]}\n");
+    fflush(stdout);
+}
+
+// initial half-width of the aspiration window around the previous score
+const double ASPIRATION_WINDOW = 25;
+
+// Iterative deepening until 1/200 of the remaining time is used or, if depth
+// is given, until an iteration reaches it.
+void SAkuna::start_search(int wtime, int btime, int depth) {
+    allocate_hash();
+    transposition.new_search();
+    tt_probes = tt_hits = tt_shared_hits = 0;
+    {
+        lock_guard<mutex> lock(helper_mutex);
+        for(SAkuna *helper : helpers) {
+            helper->board = board;
+            helper->params = params;
+            helper->search_params = search_params;
+            helper->experience_depth = experience_depth;
+            helper->root_history = &history;
+        }
+        stop = false;
+        nb_running = helpers.size();
+        ++search_id;
+    }
+    helper_cv.notify_all();
+    uint64_t allocations_before = allocation_count();
     auto start_time = chrono::steady_clock::now();
     auto cur_time = chrono::steady_clock::now();
     nb_states = 0;
+    stats.clear();
+    iterations.clear();
+    if(PROFILE)
+        profile_reset();
     if(board.player) swap(wtime, btime);
+    Move moveList[MAX_MOVES];
+    int nb_lines = min<int>(multi_pv, board.moves(moveList) - moveList);
+    for(int line = 0; line < nb_lines; ++line)
+        lines[line].score = 0;
     int max_depth;
-    for(max_depth = 2; chrono::duration_cast<chrono::milliseconds>(cur_time-start_time).count() < wtime/200; max_depth+=2) {
-        pair<Move, double> result = alphabeta(board, max_depth);
+    for(max_depth = 2; max_depth < MAX_PLY && (depth ? max_depth < depth+2
+            : chrono::duration_cast<chrono::milliseconds>(cur_time-start_time).count() < wtime/200); max_depth+=2) {
+        root_excluded.clear();
+        for(int line = 0; line < nb_lines; ++line) {
+            double alpha = -numeric_limits<double>::infinity();
+            double beta = numeric_limits<double>::infinity();
+            double delta = ASPIRATION_WINDOW;
+            if(max_depth > 2 && abs(lines[line].score) < MATE_SCORE) {
+                alpha = lines[line].score - delta;
+                beta = lines[line].score + delta;
+            }
+            pair<Move, double> result;
+            while(true) {
+                result = alphabeta(board, max_depth, 0, alpha, beta);
+                if(result.second <= alpha)
+                    alpha = result.second - delta;
+                else if(result.second >= beta)
+                    beta = result.second + delta;
+                else
+                    break;
+                STAT_INC(stats, aspiration_researches);
+                delta *= 2;
+                if(delta > 1000) {
+                    alpha = -numeric_limits<double>::infinity();
+                    beta = numeric_limits<double>::infinity();
+                }
+            }
+            lines[line].score = result.second;
+            lines[line].length = pv_length[0];
+            copy(pv[0], pv[0] + pv_length[0], lines[line].pv);
+            if(lines[line].length == 0)
+                lines[line].pv[lines[line].length++] = result.first;
+            root_excluded.push_back(lines[line].pv[0]);
+        }
+        root_excluded.clear();
         cur_time = chrono::steady_clock::now();
-        if(abs(result.second) < 1'000'000'000LL)
-            printf("info depth %d score cp %lld nodes %d nps %d\n", max_depth, (long long int)result.second, nb_states, (int)((double)nb_states / chrono::duration_cast<chrono::nanoseconds>(cur_time-start_time).count()*1'000'000'000));
-        else
-            printf("info depth %d score mate %lld nodes %d nps %d\n", max_depth, ((long long int)result.second / 1'000'000'000 + 1 + (board.player ? 1 : 0))/2, nb_states, (int)((double)nb_states / chrono::duration_cast<chrono::nanoseconds>(cur_time-start_time).count()*1'000'000'000));
-        if(result.second >= bestResult.second)
-            bestResult = result;
+        if(STATS)
+            record_iteration(max_depth);
+        for(int line = 0; line < nb_lines && verbose; ++line)
+            print_info(max_depth, line+1, nb_states,
+                    chrono::duration_cast<chrono::nanoseconds>(cur_time-start_time).count(),
+                    lines[line]);
     }
     max_depth -= 2;
-    vector<Move> pv;
-    Move cur_move = bestResult.first;
-    pv.push_back(cur_move);
-    Board newBd, curBd = board;
-    for(int i = 0; i < max_depth; ++i) {
-        curBd.do_move(cur_move, &newBd);
-        if(transposition.count(newBd)) {
-            cur_move = transposition[newBd].second.first;
-            pv.push_back(cur_move);
-        } else {
-            break;
-        }
-        curBd = newBd;
+    {
+        stop = true;
+        unique_lock<mutex> lock(helper_mutex);
+        helper_cv.wait(lock, [&] () { return nb_running == 0; });
     }
-    if(abs(bestResult.second) < 1'000'000'000LL)
-        printf("info depth %d score cp %lld nodes %d nps %d", max_depth, (long long int)bestResult.second, nb_states, (int)((double)nb_states / chrono::duration_cast<chrono::nanoseconds>(cur_time-start_time).count()*1'000'000'000));
-    else
-        printf("info depth %d score mate %lld nodes %d nps %d", max_depth, ((long long int)bestResult.second / 1'000'000'000 + 1 + (board.player ? 1 : 0))/2, nb_states, (int)((double)nb_states / chrono::duration_cast<chrono::nanoseconds>(cur_time-start_time).count()*1'000'000'000));
-    printf(" pv");
-    for(auto m : pv)
-        printf(" %s", m.toString().c_str());
-    printf("\n");
+    int nodes = nb_states;
+    stats.leaves = nb_states;
+    for(SAkuna *helper : helpers) {
+        nodes += helper->nb_states;
+        tt_probes += helper->tt_probes;
+        tt_hits += helper->tt_hits;
+        tt_shared_hits += helper->tt_shared_hits;
+        helper->stats.leaves = helper->nb_states;
+        stats += helper->stats;
+    }
+    last_nodes = nodes;
+    allocations = allocation_count() - allocations_before;
+    if(!verbose)
+        return;
     fprintf(stderr, "%d\n", (int)board.player);
-    printf("bestmove %s\n", bestResult.first.toString().c_str());
+    if(nb_lines == 0) {
+        printf("bestmove 0000\n");
+        return;
+    }
+    print_info(max_depth, 1, nodes,
+            chrono::duration_cast<chrono::nanoseconds>(cur_time-start_time).count(),
+            lines[0]);
+    printf("info string hash probes %llu hits %llu (%.1f%%) shared hits %llu (%.1f%%) hashfull %d\n",
+            (unsigned long long)tt_probes, (unsigned long long)tt_hits,
+            100.0 * tt_hits / max<uint64_t>(tt_probes, 1),
+            (unsigned long long)tt_shared_hits,
+            100.0 * tt_shared_hits / max<uint64_t>(tt_hits, 1),
+            transposition.hashfull());
+    if(STATS)
+        printf("info string stats nodes %llu interior %llu tt cutoffs %llu beta cutoffs %llu"
+                " first move %.1f%% aspiration researches %llu quiescence %llu"
+                " pruned rfp %llu razor %llu futility %llu lmp %llu"
+                " singular %llu multi-cut %llu eval cache hits %.1f%%\n",
+                (unsigned long long)stats.nodes(), (unsigned long long)stats.interior,
+                (unsigned long long)stats.tt_cutoffs, (unsigned long long)stats.beta_cutoffs,
+                percent(stats.first_move_cutoffs, stats.beta_cutoffs),
+                (unsigned long long)stats.aspiration_researches,
+                (unsigned long long)stats.quiescence,
+                (unsigned long long)stats.reverse_futility_cutoffs,
+                (unsigned long long)stats.razor_cutoffs,
+                (unsigned long long)stats.futility_pruned,
+                (unsigned long long)stats.late_move_pruned,
+                (unsigned long long)stats.singular_extensions,
+                (unsigned long long)stats.multi_cuts,
+                percent(stats.eval_hits, stats.eval_probes));
+    if(PROFILE)
+        profile_report();
+    if(ALLOC_CHECK)
+        printf("info string allocations %llu\n", (unsigned long long)allocations);
+    printf("bestmove %s\n", lines[0].pv[0].toString().c_str());
+}
+
+// a move losing this much against the engine's choice is flagged as a blunder
+const double BLUNDER_MARGIN = 200;
 
-    //// count collisions
-    //size_t collisions = 0, empty = 0;
-    //for (auto bucket = transposition.bucket_count(); bucket--;) {
-    //    if (transposition.bucket_size(bucket) == 0)
-    //        empty++;
-    //    else
-    //        collisions += transposition.bucket_size(bucket) - 1;
-    //}
-    //fprintf(stderr, "collisions = %f %f %lu %lu %lu\n",
-    //        transposition.max_load_factor(), transposition.load_factor(),
-    //        transposition.bucket_count(), collisions, empty);
+// Search the positions of a game from the last one to the first, keeping the
+// transposition table: the deep results found near the end of the game are
+// then reused by the searches of the earlier positions.
+void SAkuna::analyze_game(const string& fen, const vector<string>& moves, int depth) {
+    allocate_hash();
+    transposition.clear();
+    // still set by the end of the last start_search
+    stop = false;
+    depth = max(depth, 1);
+    auto start_time = chrono::steady_clock::now();
+    nb_states = 0;
+    vector<uint64_t> game_history = history;
+    // the moves are in long algebraic notation, SAN or PGN movetext, whose
+    // comments may have been split by the command line
+    string text;
+    for(const string &move : moves)
+        text += move + " ";
+    vector<Board> positions(1, Board(fen, {}));
+    vector<string> played_moves;
+    Move moveList[MAX_MOVES];
+    const char *p = text.c_str(), *san;
+    int len, comment = 0, variation = 0;
+    while((len = next_san(p, text.c_str() + text.size(), comment, variation, &san)) > 0) {
+        string move(san, len);
+        Board &b = positions.back();
+        Move *endMoves = b.moves(moveList);
+        Move *m = find_if(moveList, endMoves, [&] (Move &m) { return m.toString() == move; });
+        Move played;
+        if(m != endMoves)
+            played = *m;
+        else if(!parse_san(b, san, len, &played)) {
+            printf("info string illegal move %s\n", move.c_str());
+            break;
+        }
+        Board next;
+        b.do_move(played, &next);
+        positions.push_back(next);
+        played_moves.push_back(move);
+    }
+    int nb_plies = positions.size() - 1;
+    auto search = [&] (const Board &b, int depth) {
+        pair<Move, double> result;
+        for(int max_depth = 2 - depth % 2; ; max_depth += 2) {
+            result = alphabeta(b, min(max_depth, depth));
+            if(max_depth >= depth) return result;
+        }
+    };
+    vector<pair<Move, double>> results(nb_plies+1);
+    // score of each ply one ply shallower: the value of the move that led
+    // to it, with the same horizon as the score of the previous ply
+    vector<double> replies(nb_plies+1);
+    for(int ply = nb_plies; ply >= 0; --ply) {
+        history.clear();
+        for(int i = 0; i <= ply; ++i)
+            history.push_back(positions[i].key);
+        // the shallower search last: the table keeps one result per
+        // position, and the previous ply finds this one one ply below its
+        // root, at the parity of depth-1
+        results[ply] = search(positions[ply], depth);
+        if(ply > 0)
+            replies[ply] = search(positions[ply], depth-1).second;
+    }
+    for(int ply = 0; ply <= nb_plies; ++ply) {
+        double score = results[ply].second;
+        printf("info string ply %d", ply);
+        if(ply < nb_plies)
+            printf(" move %s", played_moves[ply].c_str());
+        if(abs(score) < 1'000'000'000LL)
+            printf(" score cp %lld", (long long int)score);
+        else
+            printf(" score mate %lld", ((long long int)score / 1'000'000'000 + 1 + (positions[ply].player ? 1 : 0))/2);
+        if(results[ply].first.r0 != -1)
+            printf(" best %s", results[ply].first.toString().c_str());
+        // score of the played move, seen from the side that played it; mates
+        // in a different number of moves count as the same score
+        auto capped = [] (double s) { return max(-MATE_SCORE, min(MATE_SCORE, s)); };
+        if(ply < nb_plies && capped(score) + capped(replies[ply+1]) >= BLUNDER_MARGIN)
+            printf(" blunder");
+        printf("\n");
+    }
+    history = game_history;
+    auto cur_time = chrono::steady_clock::now();
+    printf("info string analyzed %d plies depth %d nodes %d time %lld\n",
+            nb_plies+1, depth, nb_states,
+            (long long int)chrono::duration_cast<chrono::milliseconds>(cur_time-start_time).count());
+    fflush(stdout);
 }
 
 int SAkuna::perft(Board board, int depth) {
     if(depth < 1) return 1;
     Move moveList[MAX_MOVES];
+    if(depth == 1) return board.count_legal_moves();
     Move* endMoves = board.moves(moveList);
-    if(depth == 1) return endMoves - moveList;
     int nb_moves = 0;
     Board newBd;
     for(Move* m = moveList; m < endMoves; ++m) {
@@ -193,6 +900,7 @@ void SAkuna::divide(int depth) {
 }
 
 SAkuna::~SAkuna() {
+    stop_helpers();
 }
 
 
@@ -1,30 +1,179 @@
 #ifndef SAKUNA_HPP_
 #define SAKUNA_HPP_
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
 #include <string>
-#include <unordered_map>
+#include <thread>
 #include <vector>
 
 #include "board.hpp"
 #include "magicmoves.hpp"
 #include "move.hpp"
 #include "piece.hpp"
+#include "stats.hpp"
+#include "tt.hpp"
 #include "uci.hpp"
 
+const int MAX_PLY = 64;
+const int MAX_MULTI_PV = 32;
+
+// Selective search in the last FRONTIER_DEPTH plies before the horizon. The
+// margins are in centipawns per remaining ply.
+struct SearchParams {
+    // static null move: prune when the eval is this far above beta
+    double reverse_futility_margin;
+    // skip the quiet moves when the eval is this far below alpha
+    double futility_margin;
+    // check the captures only when the eval is this far below alpha
+    double razor_margin;
+    // quiet moves searched before late move pruning, plus remaining squared
+    int late_move_base;
+    // remaining plies from which the TT move is tested for singularity
+    int singular_depth;
+    // the other moves must fail below the TT score minus this per ply
+    double singular_margin;
+};
+
+const int FRONTIER_DEPTH = 3;
+extern const SearchParams default_search_params;
+
+// A parameter exposed as a UCI spin option and tuned by spsa: an integer view
+// of a field of the search or evaluation parameters, which the search reads
+// directly.
+struct TunableParam {
+    const char *name;
+    int min, max;
+    // spsa perturbation at the last iteration
+    double step;
+    // the evaluation depends on it
+    bool eval;
+    int (*get)(const SearchParams&, const EvalParams&);
+    void (*set)(SearchParams&, EvalParams&, int);
+};
+
+const int NB_TUNABLE_PARAMS = 10;
+extern const TunableParam tunable_params[NB_TUNABLE_PARAMS];
+
+// Direct-mapped cache of the static evaluation, one per engine and so per
+// thread: indexed by the low bits of the key, checked with its high half.
+struct EvalEntry {
+    uint32_t key;
+    double score;
+};
+
+const int EVAL_CACHE_SIZE = 1 << 12;
+
+// score and principal variation of one line of the last iteration
+struct Line {
+    double score;
+    int length;
+    Move pv[MAX_PLY];
+};
+
 class SAkuna {
     uci &u;
     Board board;
+    EvalParams params;
+    SearchParams search_params;
     int nb_states;
-    std::unordered_map<Board, std::pair<int, std::pair<Move, double>>> transposition;
-    std::unordered_map<Board, int> repetition;
+    uint64_t tt_probes, tt_hits, tt_shared_hits;
+    // counters of the last search, see stats.hpp
+    SearchStats stats;
+    std::vector<IterationStats> iterations;
+    std::vector<EvalEntry> eval_cache;
+    TranspositionTable own_transposition;
+    // shared with the main engine for the helpers
+    TranspositionTable &transposition;
+    // deep results of earlier runs and other processes, in a file
+    TranspositionTable own_experience;
+    TranspositionTable &experience;
+    // keys of the game positions, the last one is the current position
+    std::vector<uint64_t> history;
+    // keys of the searched line, path[0] is the root; before it comes the
+    // game history (the main engine's one for the helpers)
+    uint64_t path[MAX_PLY+1];
+    // horizon of the current iteration, before any extension
+    int root_depth;
+    // per ply, the move skipped by the singularity test of that node
+    Move excluded[MAX_PLY+1];
+    const std::vector<uint64_t> *root_history;
+    Line lines[MAX_MULTI_PV];
+    // triangular principal variation table
+    Move pv[MAX_PLY][MAX_PLY];
+    int pv_length[MAX_PLY];
+    // root moves of the previous lines, not searched by this one
+    std::vector<Move> root_excluded;
+    // operator new calls made during the last search (make ALLOC_CHECK=1)
+    uint64_t allocations;
+    // leaves of the last start_search, helpers included
+    uint64_t last_nodes;
+    int multi_pv;
+    size_t hash_size;
+    std::string shared_hash;
+    bool large_pages;
+    bool hash_dirty;
+    std::string experience_file;
+    size_t experience_size;
+    // minimum depth of the results recorded in the experience file
+    int experience_depth;
+    bool experience_dirty;
+    // print the hash allocation and the output of start_search
+    bool verbose;
+    // stop the search after this many leaves, 0 for no limit
+    int node_limit;
+    bool time_limited;
+    std::chrono::steady_clock::time_point deadline;
+    // lazy SMP: the helpers search the same position from their own threads
+    // and only communicate through the transposition table
+    int nb_threads;
+    std::atomic<bool> stop;
+    std::atomic<bool> *stop_flag;
+    std::vector<std::thread> helper_threads;
+    std::vector<SAkuna*> helpers;
+    std::mutex helper_mutex;
+    std::condition_variable helper_cv;
+    int search_id, nb_running;
+    bool quit_helpers;
+    void allocate_hash();
+    void allocate_experience();
+    bool probe(uint64_t, TTData*);
+    void start_helpers();
+    void stop_helpers();
+    void helper_loop(int);
+    void helper_search(int);
+    int repetitions(int, int) const;
+    void count_leaf();
+    double evaluate(const Board&);
+    void prefetch_eval(uint64_t) const;
+    void clear_eval_cache();
+    double quiesce(Board&, double, double);
+    void print_info(int, int, int, int64_t, const Line&);
+    void record_iteration(int);
     public:
-    SAkuna(uci&);
+    SAkuna(uci&, SAkuna* main_engine = nullptr);
     void init();
+    void new_game();
+    void set_option(const std::string&, const std::string&);
     void set_position(const std::string&, const std::vector<std::string>&);
+    // self-play: set a position without history, then play moves on it
+    void set_position(const Board&);
+    int play(Move);
+    const Board& position() const { return board; }
+    void set_verbose(bool v) { verbose = v; }
+    uint64_t search_allocations() const { return allocations; }
+    uint64_t nodes_searched() const { return last_nodes; }
     bool check();
     bool valid(Move);
     std::pair<Move, double> alphabeta(Board, int, int, double, double);
-    void start_search(int, int);
+    void start_search(int, int, int depth = 0);
+    std::pair<Move, double> search_nodes(int, int movetime = 0, int depth = 0,
+            const std::function<void(int, Move)> &on_iteration = nullptr);
+    void print_stats();
+    void analyze_game(const std::string&, const std::vector<std::string>&, int);
     void display_board();
     int perft(Board, int);
     void divide(int);
@@ -0,0 +1,202 @@
+#include "spsa.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "datagen.hpp"
+#include "match.hpp"
+#include "sakuna.hpp"
+
+using namespace std;
+
+// the usual SPSA gain decay exponents
+const double SPSA_ALPHA = 0.602;
+const double SPSA_GAMMA = 0.101;
+
+struct SpsaConfig {
+    int iterations = 10000;
+    int concurrency = max(1u, thread::hardware_concurrency());
+    int nodes = 0;
+    int movetime = 0;
+    int random_plies = 8;
+    // learning rate at the last iteration, per step squared
+    double rate = 0.002;
+    // indices in tunable_params
+    vector<int> tuned;
+    string out;
+    vector<pair<string, string>> options;
+};
+
+static int find_param(const string &name) {
+    for(int i = 0; i < NB_TUNABLE_PARAMS; ++i)
+        if(name == tunable_params[i].name)
+            return i;
+    return -1;
+}
+
+struct Spsa {
+    const SpsaConfig &cfg;
+    // the tuned values, kept fractional between the games
+    vector<double> theta;
+    atomic<int> next_iteration{0};
+    int done = 0;
+    mutex theta_mutex;
+    Spsa(const SpsaConfig &c, const vector<double> &start) : cfg(c), theta(start) {}
+
+    double clamp_value(int i, double v) const {
+        const TunableParam &t = tunable_params[cfg.tuned[i]];
+        return max<double>(t.min, min<double>(t.max, v));
+    }
+
+    void set_values(SAkuna &engine, const vector<double> &values) {
+        for(size_t i = 0; i < cfg.tuned.size(); ++i)
+            engine.set_option(tunable_params[cfg.tuned[i]].name, to_string(lround(values[i])));
+    }
+
+    void print_values(FILE *f, const char *sep) {
+        for(size_t i = 0; i < cfg.tuned.size(); ++i)
+            fprintf(f, "%s%s=%ld", i ? sep : "", tunable_params[cfg.tuned[i]].name,
+                    lround(theta[i]));
+        fprintf(f, "\n");
+    }
+
+    void worker() {
+        uci u;
+        SAkuna plus(u), minus(u);
+        for(SAkuna *e : {&plus, &minus}) {
+            e->set_verbose(false);
+            e->set_option("Hash", "16");
+            for(const auto &opt : cfg.options)
+                if(find_param(opt.first) == -1)
+                    e->set_option(opt.first, opt.second);
+        }
+        const Board start_position(u.start_fen, {});
+        int n = cfg.iterations, k;
+        // a_k = a / (A + k + 1)^alpha and c_k = c / (k + 1)^gamma, scaled so
+        // that the last iteration uses step and rate * step^2
+        double big_a = 0.1 * n;
+        vector<double> c(cfg.tuned.size()), delta(cfg.tuned.size());
+        vector<double> values[2] = {vector<double>(cfg.tuned.size()), vector<double>(cfg.tuned.size())};
+        while((k = next_iteration++) < n) {
+            mt19937_64 rng(k);
+            double c_scale = pow((double)n / (k + 1), SPSA_GAMMA);
+            double a_scale = pow((big_a + n) / (big_a + k + 1), SPSA_ALPHA);
+            {
+                lock_guard<mutex> lock(theta_mutex);
+                for(size_t i = 0; i < cfg.tuned.size(); ++i) {
+                    c[i] = tunable_params[cfg.tuned[i]].step * c_scale;
+                    delta[i] = rng() & 1 ? 1 : -1;
+                    values[0][i] = clamp_value(i, theta[i] + c[i] * delta[i]);
+                    values[1][i] = clamp_value(i, theta[i] - c[i] * delta[i]);
+                }
+            }
+            set_values(plus, values[0]);
+            set_values(minus, values[1]);
+            plus.new_game();
+            random_opening(plus, start_position, cfg.random_plies, rng);
+            Board start = plus.position();
+            // both colors of the opening, result from plus' point of view
+            SAkuna *engines[2] = {&plus, &minus};
+            int result = play_game(engines, start, cfg.nodes, cfg.movetime);
+            swap(engines[0], engines[1]);
+            result -= play_game(engines, start, cfg.nodes, cfg.movetime);
+            lock_guard<mutex> lock(theta_mutex);
+            for(size_t i = 0; i < cfg.tuned.size(); ++i) {
+                // a_k / c_k per point of the pair
+                double gain = cfg.rate * tunable_params[cfg.tuned[i]].step * a_scale / c_scale;
+                theta[i] = clamp_value(i, theta[i] + gain * result * delta[i]);
+            }
+            if(++done % 100 == 0 || done == n) {
+                printf("Iteration %d/%d: ", done, n);
+                print_values(stdout, " ");
+                fflush(stdout);
+            }
+        }
+    }
+};
+
+int spsa(int argc, char **argv) {
+    SpsaConfig cfg;
+    for(int i = 0; i < argc; ++i) {
+        string arg = argv[i];
+        size_t eq = arg.find('=');
+        if(eq != string::npos) {
+            // search_nodes only runs the main thread: helpers would stay idle
+            if(arg.substr(0, eq) == "Threads") {
+                fprintf(stderr, "spsa: Threads is not supported, use concurrency\n");
+                return 1;
+            }
+            cfg.options.emplace_back(arg.substr(0, eq), arg.substr(eq + 1));
+            continue;
+        }
+        if(i + 1 >= argc) {
+            fprintf(stderr, "spsa: missing value for %s\n", argv[i]);
+            return 1;
+        }
+        string value = argv[++i];
+        if(arg == "iterations") cfg.iterations = max(1, atoi(value.c_str()));
+        else if(arg == "concurrency") cfg.concurrency = max(1, atoi(value.c_str()));
+        else if(arg == "nodes") cfg.nodes = max(0, atoi(value.c_str()));
+        else if(arg == "movetime") cfg.movetime = max(0, atoi(value.c_str()));
+        else if(arg == "random") cfg.random_plies = atoi(value.c_str());
+        else if(arg == "rate") cfg.rate = atof(value.c_str());
+        else if(arg == "out") cfg.out = value;
+        else if(arg == "params") {
+            istringstream names(value);
+            string name;
+            while(getline(names, name, ',')) {
+                int p = find_param(name);
+                if(p == -1) {
+                    fprintf(stderr, "spsa: unknown parameter %s\n", name.c_str());
+                    return 1;
+                }
+                cfg.tuned.push_back(p);
+            }
+        } else {
+            fprintf(stderr, "spsa: unknown option %s\n", arg.c_str());
+            return 1;
+        }
+    }
+    if(cfg.tuned.empty())
+        for(int i = 0; i < NB_TUNABLE_PARAMS; ++i)
+            cfg.tuned.push_back(i);
+    if(cfg.nodes == 0 && cfg.movetime == 0)
+        cfg.nodes = 5000;
+    vector<double> start;
+    for(int p : cfg.tuned)
+        start.push_back(tunable_params[p].get(default_search_params, eval_params));
+    for(const auto &opt : cfg.options) {
+        auto it = find(cfg.tuned.begin(), cfg.tuned.end(), find_param(opt.first));
+        if(it != cfg.tuned.end())
+            start[it - cfg.tuned.begin()] = atof(opt.second.c_str());
+    }
+    printf("spsa: %d parameters, %d iterations, concurrency %d, %s %d\n",
+            (int)cfg.tuned.size(), cfg.iterations, cfg.concurrency,
+            cfg.nodes ? "nodes" : "movetime", cfg.nodes ? cfg.nodes : cfg.movetime);
+    fflush(stdout);
+    Spsa s(cfg, start);
+    vector<thread> threads;
+    for(int i = 0; i < cfg.concurrency; ++i)
+        threads.emplace_back(&Spsa::worker, &s);
+    for(thread &t : threads)
+        t.join();
+    if(!cfg.out.empty()) {
+        FILE *f = fopen(cfg.out.c_str(), "w");
+        if(f == nullptr) {
+            fprintf(stderr, "spsa: cannot write %s\n", cfg.out.c_str());
+            return 1;
+        }
+        s.print_values(f, "\n");
+        fclose(f);
+    }
+    return 0;
+}
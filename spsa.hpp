@@ -0,0 +1,13 @@
+#ifndef SPSA_HPP_
+#define SPSA_HPP_
+
+// SAkuna spsa [iterations N] [concurrency N] [nodes N] [movetime MS] [random N]
+//             [rate X] [params NAME,NAME...] [out FILE] [Option=value]...
+// Tunes the parameters of tunable_params (all of them, or those listed) by
+// simultaneous perturbation: each iteration plays a game pair between the
+// current values moved by +step and by -step, with random signs per
+// parameter, and moves the values toward the winner. Option=value sets the
+// starting value of a tuned parameter, or an option of both engines.
+int spsa(int argc, char **argv);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef STATS_HPP_
+#define STATS_HPP_
+
+#include <cstdint>
+
+// Search counters, compiled in with make STATS=1. Without it the STAT_*
+// macros expand to nothing and the counters stay at zero.
+#ifndef STATS
+#define STATS 0
+#endif
+
+#if STATS
+#define STAT_INC(s, field) (++(s).field)
+#define STAT_ADD(s, field, n) ((s).field += (n))
+#else
+#define STAT_INC(s, field) ((void)0)
+#define STAT_ADD(s, field, n) ((void)0)
+#endif
+
+struct SearchStats {
+    uint64_t interior;
+    // the leaves, quiescence nodes included, are counted by nb_states
+    uint64_t leaves;
+    uint64_t tt_cutoffs;
+    uint64_t beta_cutoffs;
+    uint64_t first_move_cutoffs;
+    uint64_t aspiration_researches;
+    uint64_t quiescence;
+    uint64_t reverse_futility_cutoffs;
+    uint64_t razor_cutoffs;
+    uint64_t futility_pruned;
+    uint64_t late_move_pruned;
+    uint64_t singular_extensions;
+    uint64_t multi_cuts;
+    uint64_t eval_probes;
+    uint64_t eval_hits;
+    void clear() { *this = SearchStats(); }
+    SearchStats& operator+=(const SearchStats &o) {
+        interior += o.interior;
+        leaves += o.leaves;
+        tt_cutoffs += o.tt_cutoffs;
+        beta_cutoffs += o.beta_cutoffs;
+        first_move_cutoffs += o.first_move_cutoffs;
+        aspiration_researches += o.aspiration_researches;
+        quiescence += o.quiescence;
+        reverse_futility_cutoffs += o.reverse_futility_cutoffs;
+        razor_cutoffs += o.razor_cutoffs;
+        futility_pruned += o.futility_pruned;
+        late_move_pruned += o.late_move_pruned;
+        singular_extensions += o.singular_extensions;
+        multi_cuts += o.multi_cuts;
+        eval_probes += o.eval_probes;
+        eval_hits += o.eval_hits;
+        return *this;
+    }
+    uint64_t nodes() const { return interior + leaves; }
+};
+
+// nodes searched by one iteration of the main thread
+struct IterationStats {
+    int depth;
+    uint64_t nodes;
+};
+
+#endif
@@ -0,0 +1,121 @@
+#include "system.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+const size_t HUGE_PAGE_SIZE = 2 << 20;
+const int MPOL_INTERLEAVE = 3;
+
+static size_t round_up(size_t size) {
+    return (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+}
+
+static bool transparent_huge_pages() {
+    ifstream in("/sys/kernel/mm/transparent_hugepage/enabled");
+    string mode;
+    getline(in, mode);
+    return in && mode.find("[never]") == string::npos;
+}
+
+// cpus of each NUMA node, read from sysfs
+static const vector<vector<int>>& node_cpus() {
+    static vector<vector<int>> nodes = [] () {
+        vector<vector<int>> nodes;
+        for(int n = 0; ; ++n) {
+            ifstream in("/sys/devices/system/node/node" + to_string(n) + "/cpulist");
+            string list;
+            if(!getline(in, list)) break;
+            vector<int> cpus;
+            istringstream iss(list);
+            string range;
+            while(getline(iss, range, ',')) {
+                size_t dash = range.find('-');
+                int lo = stoi(range.substr(0, dash));
+                int hi = dash == string::npos ? lo : stoi(range.substr(dash+1));
+                for(int c = lo; c <= hi; ++c)
+                    cpus.push_back(c);
+            }
+            nodes.push_back(cpus);
+        }
+        return nodes;
+    }();
+    return nodes;
+}
+
+int numa_nodes() {
+    return max(1, (int)node_cpus().size());
+}
+
+void* large_alloc(size_t size, bool large_pages, string* report) {
+    size = round_up(size);
+    void *mem = MAP_FAILED;
+    if(large_pages) {
+        mem = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(mem != MAP_FAILED)
+            *report = "explicit huge pages";
+    }
+    if(mem == MAP_FAILED) {
+        mem = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(mem == MAP_FAILED)
+            return nullptr;
+        if(large_pages && madvise(mem, size, MADV_HUGEPAGE) == 0
+                && transparent_huge_pages())
+            *report = "transparent huge pages";
+        else
+            *report = "normal pages";
+    }
+    // spread the table over the nodes instead of the first toucher's one
+    if(numa_nodes() > 1) {
+        unsigned long mask = (1UL << min(numa_nodes(), 64)) - 1;
+        syscall(SYS_mbind, mem, size, MPOL_INTERLEAVE, &mask, 64, 0);
+    }
+    return mem;
+}
+
+void large_free(void* mem, size_t size) {
+    munmap(mem, round_up(size));
+}
+
+const char* map_file(const string& path, size_t* size) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        return nullptr;
+    struct stat st;
+    void *mem = MAP_FAILED;
+    if(fstat(fd, &st) == 0 && st.st_size > 0) {
+        *size = st.st_size;
+        mem = mmap(nullptr, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if(mem == MAP_FAILED)
+        return nullptr;
+    madvise(mem, *size, MADV_SEQUENTIAL);
+    return static_cast<const char*>(mem);
+}
+
+void unmap_file(const char* mem, size_t size) {
+    munmap(const_cast<char*>(mem), size);
+}
+
+void bind_thread(int index) {
+    if(numa_nodes() < 2) return;
+    const vector<int> &cpus = node_cpus()[index % numa_nodes()];
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(int c : cpus)
+        CPU_SET(c, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
@@ -0,0 +1,21 @@
+#ifndef SYSTEM_HPP_
+#define SYSTEM_HPP_
+
+#include <cstddef>
+#include <string>
+
+// Memory and processor placement helpers (Linux only).
+
+// Allocate zeroed memory, on 2 MB pages when possible. The kind of pages
+// obtained is written to report.
+void* large_alloc(size_t, bool large_pages, std::string* report);
+void large_free(void*, size_t);
+int numa_nodes();
+// Pin the calling thread to the processors of NUMA node (index % nodes).
+void bind_thread(int index);
+// Map a file read only, read sequentially. nullptr if it cannot be opened
+// or is empty.
+const char* map_file(const std::string& path, size_t* size);
+void unmap_file(const char*, size_t);
+
+#endif
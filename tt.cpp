@@ -0,0 +1,232 @@
+#include "tt.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "profile.hpp"
+#include "system.hpp"
+
+using namespace std;
+
+const double MATE_SCORE = 1'000'000'000LL;
+// mates are stored as +-(TT_MATE + plies)
+const int32_t TT_MATE = 1 << 22;
+const int GENERATION_MASK = 63;
+// depth an entry loses per search since it was written, for the replacement
+const int AGE_PENALTY = 2;
+
+/* data layout:
+    bits  0-15 move (from, to, promotion), 0 if none
+    bits 16-23 depth
+    bits 24-25 bound
+    bits 26-31 generation
+    bits 32-39 owner (process which wrote the entry)
+    bits 40-63 score */
+static uint64_t pack_move(Move m) {
+    if(m.r0 == -1) return 0;
+    return (8*m.r0+m.c0) | ((8*m.r1+m.c1) << 6) | (m.p << 12);
+}
+
+static Move unpack_move(uint64_t data) {
+    data &= 0xFFFF;
+    if(data == 0) return Move(-1, -1, -1, -1);
+    return Move(data & 63, (data >> 6) & 63, data >> 12);
+}
+
+// fractional scores are rounded so that the bound stays true
+static uint64_t pack_score(double score, Bound bound) {
+    int32_t v;
+    if(abs(score) < MATE_SCORE)
+        v = bound == BOUND_LOWER ? floor(score) : bound == BOUND_UPPER ? ceil(score) : lround(score);
+    else
+        v = (score > 0 ? 1 : -1) * (TT_MATE + (int32_t)(abs(score) / MATE_SCORE));
+    return (uint64_t)(uint32_t)v << 40;
+}
+
+static double unpack_score(uint64_t data) {
+    int32_t v = (int64_t)data >> 40;
+    if(abs(v) < TT_MATE)
+        return v;
+    return (v > 0 ? 1 : -1) * (abs(v) - TT_MATE) * MATE_SCORE;
+}
+
+static int entry_depth(uint64_t data) {
+    return (data >> 16) & 255;
+}
+
+static int entry_generation(uint64_t data) {
+    return (data >> 26) & GENERATION_MASK;
+}
+
+TranspositionTable::TranspositionTable() :
+    buckets(nullptr), nb_buckets(0), size(0), private_header(),
+    header(&private_header), owner(1) {
+}
+
+void TranspositionTable::release() {
+    if(buckets == nullptr) return;
+    if(is_shared())
+        munmap(header, size);
+    else
+        large_free(buckets, size);
+    buckets = nullptr;
+    nb_buckets = size = 0;
+    shared_name.clear();
+    header = &private_header;
+    owner = 1;
+}
+
+// Map a table shared with other processes on fd, which is closed. An existing
+// table keeps its own size, a new one gets the requested size.
+bool TranspositionTable::map_shared(int fd, const string& name, bool large_pages) {
+    if(fd == -1) return false;
+    struct stat st;
+    void *mem = MAP_FAILED;
+    if(fstat(fd, &st) == 0) {
+        if(st.st_size > 0)
+            size = st.st_size;
+        else if(ftruncate(fd, size) != 0)
+            size = 0;
+        if(size > sizeof(TTBucket))
+            mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if(mem == MAP_FAILED)
+        return false;
+    if(large_pages)
+        madvise(mem, size, MADV_HUGEPAGE);
+    // the header takes the first bucket
+    header = (TTHeader*)mem;
+    buckets = (TTBucket*)mem + 1;
+    nb_buckets = size / sizeof(TTBucket) - 1;
+    owner = header->processes++ % 255 + 1;
+    shared_name = name;
+    return true;
+}
+
+// Allocate a table of mb megabytes, either private or in the named POSIX
+// shared memory segment, which is created if it does not exist yet; a private
+// table is allocated when the segment cannot be attached. False, and no table
+// left, if the memory cannot be obtained.
+bool TranspositionTable::resize(size_t mb, const string& name, bool large_pages) {
+    release();
+    size = mb << 20;
+    if(!name.empty()) {
+        string path = name[0] == '/' ? name : "/" + name;
+        if(map_shared(shm_open(path.c_str(), O_CREAT | O_RDWR, 0600), path, large_pages)) {
+            allocation = "shared memory " + path;
+            return true;
+        }
+        // fall back to a private table
+        size = mb << 20;
+    }
+    buckets = (TTBucket*)large_alloc(size, large_pages, &allocation);
+    if(buckets == nullptr) {
+        size = 0;
+        return false;
+    }
+    nb_buckets = size / sizeof(TTBucket);
+    // fault the pages in now rather than during the first search
+    clear();
+    return true;
+}
+
+// Map the table stored in a regular file, created with mb megabytes if it does
+// not exist yet, or unmap the table if path is empty. The writes of every
+// process reach the file through the page cache and outlive them; it is never
+// cleared.
+bool TranspositionTable::open_file(size_t mb, const string& path) {
+    release();
+    size = mb << 20;
+    if(!path.empty() && map_shared(open(path.c_str(), O_CREAT | O_RDWR, 0644), path, false)) {
+        allocation = "file " + path;
+        return true;
+    }
+    size = 0;
+    return false;
+}
+
+void TranspositionTable::clear() {
+    // the other processes attached to a shared table are still using it
+    if(is_shared()) return;
+    memset(buckets, 0, nb_buckets * sizeof(TTBucket));
+}
+
+bool TranspositionTable::probe(uint64_t key, TTData *ttData) const {
+    PROFILE_SCOPE(ZONE_TT_PROBE);
+    TTBucket &bucket = buckets[bucket_index(key, nb_buckets)];
+    for(int i = 0; i < TT_BUCKET_SIZE; ++i) {
+        uint64_t data = bucket.entry[i].data;
+        if((bucket.entry[i].key ^ data) != key || data == 0)
+            continue;
+        ttData->foreign = ((data >> 32) & 255) != owner;
+        ttData->move = unpack_move(data);
+        ttData->depth = entry_depth(data);
+        ttData->bound = Bound((data >> 24) & 3);
+        ttData->score = unpack_score(data);
+        // still in use: keep it from aging
+        uint64_t generation = header->generation & GENERATION_MASK;
+        if((uint64_t)entry_generation(data) != generation) {
+            data = (data & ~((uint64_t)GENERATION_MASK << 26)) | generation << 26;
+            bucket.entry[i].key = key ^ data;
+            bucket.entry[i].data = data;
+        }
+        return true;
+    }
+    return false;
+}
+
+void TranspositionTable::store(uint64_t key, int depth, Bound bound, double score, Move move) {
+    PROFILE_SCOPE(ZONE_TT_STORE);
+    TTBucket &bucket = buckets[bucket_index(key, nb_buckets)];
+    int generation = header->generation & GENERATION_MASK;
+    // depth of an entry, less what its age makes it worth
+    auto worth = [&] (uint64_t data) {
+        return entry_depth(data) - AGE_PENALTY * ((generation - entry_generation(data)) & GENERATION_MASK);
+    };
+    TTEntry *replace = &bucket.entry[0];
+    for(int i = 0; i < TT_BUCKET_SIZE; ++i) {
+        TTEntry *entry = &bucket.entry[i];
+        uint64_t data = entry->data;
+        if((entry->key ^ data) == key) {
+            // keep a deeper bound of the same position from this search
+            if(depth < entry_depth(data) && bound != BOUND_EXACT
+                    && entry_generation(data) == generation)
+                return;
+            if(move.r0 == -1)
+                move = unpack_move(data);
+            replace = entry;
+            break;
+        }
+        // replace the shallowest and oldest entry of the bucket
+        if(worth(data) < worth(replace->data))
+            replace = entry;
+    }
+    uint64_t data = pack_move(move) | ((uint64_t)min(depth, 255) << 16)
+        | ((uint64_t)bound << 24) | ((uint64_t)generation << 26) | (owner << 32)
+        | pack_score(score, bound);
+    replace->key = key ^ data;
+    replace->data = data;
+}
+
+// permille of the table used by the current search, sampled on the first
+// entries
+int TranspositionTable::hashfull() const {
+    int generation = header->generation & GENERATION_MASK;
+    int cnt = 0;
+    for(int i = 0; i < 250 && i < (int)nb_buckets; ++i)
+        for(int j = 0; j < TT_BUCKET_SIZE; ++j)
+            cnt += buckets[i].entry[j].data != 0
+                && entry_generation(buckets[i].entry[j].data) == generation;
+    return cnt;
+}
+
+TranspositionTable::~TranspositionTable() {
+    release();
+}
@@ -0,0 +1,83 @@
+#ifndef TT_HPP_
+#define TT_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "move.hpp"
+
+enum Bound : int {
+    BOUND_NONE, BOUND_UPPER, BOUND_LOWER, BOUND_EXACT
+};
+
+struct TTData {
+    Move move;
+    double score;
+    int depth;
+    Bound bound;
+    bool foreign; // written by another process
+};
+
+/* An entry stores its key xored with its data: a torn write (from another
+    thread or another process) then fails the key check instead of returning
+    the data of another position. */
+struct TTEntry {
+    uint64_t key;
+    uint64_t data;
+};
+
+const int TT_BUCKET_SIZE = 4;
+
+struct alignas(64) TTBucket {
+    TTEntry entry[TT_BUCKET_SIZE];
+};
+
+/* State of a table, in its first bucket when it is shared between
+    processes: the generation of the entries being written, incremented by
+    every search, and the count of the processes that attached to it, which
+    hands each of them its own owner tag. */
+struct alignas(64) TTHeader {
+    std::atomic<uint32_t> generation;
+    std::atomic<uint32_t> processes;
+};
+
+static_assert(sizeof(TTHeader) == sizeof(TTBucket), "the header takes one bucket");
+
+inline size_t bucket_index(uint64_t key, size_t nb_buckets) {
+    return ((unsigned __int128)key * nb_buckets) >> 64;
+}
+
+class TranspositionTable {
+    TTBucket *buckets;
+    size_t nb_buckets;
+    size_t size;
+    std::string shared_name;
+    TTHeader private_header;
+    TTHeader *header;
+    uint64_t owner;
+    void release();
+    bool map_shared(int fd, const std::string& name, bool large_pages);
+    public:
+    // kind of memory obtained by the last resize
+    std::string allocation;
+    TranspositionTable();
+    bool resize(size_t, const std::string& = "", bool large_pages = false);
+    bool open_file(size_t, const std::string&);
+    void clear();
+    // age the entries of the previous searches
+    void new_search() { ++header->generation; }
+    bool probe(uint64_t, TTData*) const;
+    // start loading the bucket of a position that will be probed soon
+    void prefetch(uint64_t key) const {
+        __builtin_prefetch(&buckets[bucket_index(key, nb_buckets)]);
+    }
+    void store(uint64_t, int, Bound, double, Move);
+    int hashfull() const;
+    bool is_shared() const { return !shared_name.empty(); }
+    bool is_allocated() const { return buckets != nullptr; }
+    ~TranspositionTable();
+};
+
+#endif
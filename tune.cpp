@@ -0,0 +1,333 @@
+#include "tune.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "board.hpp"
+#include "datagen.hpp"
+#include "endgame.hpp"
+
+using namespace std;
+
+const int MAX_MOVES = 256;
+// depth limit of the capture search resolving the positions
+const int QS_MAX_PLY = 12;
+const double ADAM_BETA1 = 0.9;
+const double ADAM_BETA2 = 0.999;
+
+/* Texel tuning: the evaluation of the quiet leaf of each position is linear
+    in the parameters, score = base + scale * sum(coef * param). Positions
+    are stored as structure of arrays, one shard per thread. */
+struct Dataset {
+    // features of position i: [start[i], start[i+1])
+    vector<uint32_t> start;
+    vector<uint16_t> index;
+    vector<int8_t> coef;
+    vector<float> base, scale;
+    // game result for white: 0, 0.5 or 1
+    vector<float> result;
+    // per position work space of an epoch
+    vector<float> weight;
+    Dataset() : start(1, 0) {}
+    size_t size() const { return result.size(); }
+};
+
+// Raw input: datagen records and EPD lines.
+struct Input {
+    vector<PackedPosition> packed;
+    string text;
+    vector<size_t> lines;
+    size_t size() const { return packed.size() + lines.size(); }
+};
+
+template<typename F>
+static void parallel(int nb_threads, F f) {
+    vector<thread> threads;
+    for(int t = 0; t < nb_threads; ++t)
+        threads.emplace_back(f, t);
+    for(thread &t : threads)
+        t.join();
+}
+
+static bool read_input(const string &path, Input &in) {
+    ifstream file(path, ios::binary);
+    if(!file) return false;
+    string data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    if(path.size() > 4 && path.substr(path.size() - 4) == ".bin") {
+        size_t n = data.size() / sizeof(PackedPosition);
+        size_t old = in.packed.size();
+        in.packed.resize(old + n);
+        memcpy(&in.packed[old], data.data(), n * sizeof(PackedPosition));
+        return true;
+    }
+    size_t offset = in.text.size();
+    in.text += data;
+    in.text += '\n';
+    for(size_t i = offset; i < in.text.size(); i = in.text.find('\n', i) + 1)
+        if(in.text[i] != '\n')
+            in.lines.push_back(i);
+    return true;
+}
+
+// "fen c9 "1-0";" or "fen [1.0]", result for white
+static bool parse_epd(const char *line, Board *b, double *result) {
+    const char *end = strchr(line, '\n');
+    istringstream iss(string(line, end));
+    string fields[4];
+    for(string &f : fields)
+        if(!(iss >> f)) return false;
+    string rest;
+    getline(iss, rest);
+    if(rest.find("1/2-1/2") != string::npos || rest.find("[0.5]") != string::npos)
+        *result = 0.5;
+    else if(rest.find("1-0") != string::npos || rest.find("[1.0]") != string::npos)
+        *result = 1;
+    else if(rest.find("0-1") != string::npos || rest.find("[0.0]") != string::npos)
+        *result = 0;
+    else
+        return false;
+    *b = Board(fields[0] + " " + fields[1] + " " + fields[2] + " " + fields[3] + " 0 1", {});
+    return true;
+}
+
+// Captures and promotions only. Returns the score for the side to move and
+// the last position of the principal variation.
+static double quiesce(Board &b, double alpha, double beta, int ply, Board *leaf) {
+    double stand_pat = b.eval();
+    *leaf = b;
+    if(stand_pat >= beta || ply == QS_MAX_PLY)
+        return stand_pat;
+    alpha = max(alpha, stand_pat);
+    double best = stand_pat;
+    Move moveList[MAX_MOVES];
+    Move *endMoves = b.moves(moveList);
+    // most valuable victim first, then least valuable attacker
+    pair<int, Move*> captures[MAX_MOVES];
+    int nb_captures = 0;
+    for(Move *m = moveList; m < endMoves; ++m) {
+        Piece_Type victim = b.piece_on(Square(8*m->r1 + m->c1));
+        if(victim == pt_empty && m->p == 0)
+            continue;
+        captures[nb_captures++] = {8*victim - b.piece_on(Square(8*m->r0 + m->c0)), m};
+    }
+    sort(captures, captures + nb_captures, [] (const pair<int, Move*> &x, const pair<int, Move*> &y) {
+        return x.first > y.first;
+    });
+    Board newBd, newLeaf;
+    for(int i = 0; i < nb_captures; ++i) {
+        b.do_move(*captures[i].second, &newBd);
+        double score = -quiesce(newBd, -beta, -alpha, ply+1, &newLeaf);
+        if(score > best) {
+            best = score;
+            *leaf = newLeaf;
+        }
+        alpha = max(alpha, score);
+        if(alpha >= beta)
+            break;
+    }
+    return best;
+}
+
+// Features of the generic evaluation, mirrors Board::eval (white's point of
+// view). False if the position has a specialized evaluation.
+static bool add_position(Dataset &d, const Board &b, double result) {
+    const MaterialEntry *me = material_probe(b, eval_params);
+    if(me->evaluate)
+        return false;
+    int coef[NB_EVAL_PARAMS] = {};
+    for(int p = 0; p < 2; ++p)
+        for(int pt = 0; pt < 6; ++pt) {
+            Bitboard bb = b.pieces(p, pt);
+            while(bb) {
+                int sq = __builtin_ctzll(bb);
+                bb &= bb - 1;
+                int sign = 1 - 2*p;
+                if(pt < 5)
+                    coef[pt] += sign;
+                int table = me->endgame && (pt == pt_pawn || pt == pt_king) ?
+                    pt + (pt == pt_pawn ? 6 : 2) : pt;
+                int row = p ? sq/8 : 7 - sq/8, col = p ? sq%8 : 7 - sq%8;
+                coef[offsetof(EvalParams, position_table) / sizeof(double)
+                    + 64*table + 8*row + col] += sign;
+            }
+        }
+    // the side favoured by the built-in parameters picks the scale factor
+    double score = -me->imbalance;
+    for(int i = 0; i < NB_EVAL_PARAMS; ++i)
+        if(coef[i]) {
+            d.index.push_back(i);
+            d.coef.push_back(coef[i]);
+            score += coef[i] * param_vector(eval_params)[i];
+        }
+    double scale = me->scale[score < 0];
+    if(me->scale_position)
+        scale *= me->scale_position(b, me->strong);
+    d.start.push_back(d.index.size());
+    d.base.push_back(-me->imbalance * scale);
+    d.scale.push_back(scale);
+    d.result.push_back(result);
+    return true;
+}
+
+static void build_shard(const Input &in, size_t from, size_t to, Dataset &d) {
+    Move moveList[MAX_MOVES];
+    for(size_t i = from; i < to; ++i) {
+        Board b;
+        double result;
+        if(i < in.packed.size()) {
+            b = unpack_position(in.packed[i]);
+            int r = b.player ? -in.packed[i].result : in.packed[i].result;
+            result = (r + 1) / 2.0;
+        } else if(!parse_epd(&in.text[in.lines[i - in.packed.size()]], &b, &result)) {
+            continue;
+        }
+        // the leaf of a position in check or without moves is not quiet
+        if(b.moves(moveList) == moveList || b.checkers)
+            continue;
+        Board leaf;
+        quiesce(b, -1e18, 1e18, 0, &leaf);
+        add_position(d, leaf, result);
+    }
+    d.weight.resize(d.size());
+}
+
+static inline double sigmoid(double score, double k) {
+    return 1 / (1 + exp(-k * score * log(10) / 400));
+}
+
+// Sum of the squared errors of a shard. With grad, also adds the gradient
+// (up to the constant factor 2 k ln(10) / 400).
+static double shard_loss(Dataset &d, const float *params, double k, double *grad) {
+    size_t n = d.size();
+    double loss = 0;
+    for(size_t i = 0; i < n; ++i) {
+        float s = 0;
+        for(uint32_t j = d.start[i]; j < d.start[i+1]; ++j)
+            s += d.coef[j] * params[d.index[j]];
+        double sig = sigmoid(d.base[i] + d.scale[i] * s, k);
+        double err = sig - d.result[i];
+        loss += err * err;
+        d.weight[i] = err * sig * (1 - sig) * d.scale[i];
+    }
+    if(grad)
+        for(size_t i = 0; i < n; ++i)
+            for(uint32_t j = d.start[i]; j < d.start[i+1]; ++j)
+                grad[d.index[j]] += d.weight[i] * d.coef[j];
+    return loss;
+}
+
+static double total_loss(vector<Dataset> &shards, const double *params, double k,
+        vector<vector<double>> *grads) {
+    vector<float> fparams(params, params + NB_EVAL_PARAMS);
+    vector<double> losses(shards.size());
+    parallel(shards.size(), [&] (int t) {
+        double *grad = nullptr;
+        if(grads) {
+            (*grads)[t].assign(NB_EVAL_PARAMS, 0);
+            grad = (*grads)[t].data();
+        }
+        losses[t] = shard_loss(shards[t], fparams.data(), k, grad);
+    });
+    double loss = 0;
+    for(double l : losses) loss += l;
+    return loss;
+}
+
+// scaling constant of the sigmoid which fits the current evaluation best
+static double fit_k(vector<Dataset> &shards, const double *params, size_t n) {
+    double lo = 0.1, hi = 4;
+    for(int it = 0; it < 40; ++it) {
+        double m1 = lo + (hi - lo) / 3, m2 = hi - (hi - lo) / 3;
+        if(total_loss(shards, params, m1, nullptr) < total_loss(shards, params, m2, nullptr))
+            hi = m2;
+        else
+            lo = m1;
+    }
+    double k = (lo + hi) / 2;
+    printf("k %.4f loss %.6f\n", k, total_loss(shards, params, k, nullptr) / n);
+    return k;
+}
+
+int tune(int argc, char **argv) {
+    int nb_threads = max(1u, thread::hardware_concurrency());
+    int epochs = 300;
+    double rate = 1;
+    string out = "tuned";
+    Input in;
+    for(int i = 0; i < argc; ++i) {
+        string arg = argv[i];
+        if(i + 1 < argc && arg == "threads") nb_threads = max(1, atoi(argv[++i]));
+        else if(i + 1 < argc && arg == "epochs") epochs = atoi(argv[++i]);
+        else if(i + 1 < argc && arg == "rate") rate = atof(argv[++i]);
+        else if(i + 1 < argc && arg == "out") out = argv[++i];
+        else if(!read_input(arg, in)) {
+            fprintf(stderr, "tune: cannot read %s\n", arg.c_str());
+            return 1;
+        }
+    }
+    auto start_time = chrono::steady_clock::now();
+    auto elapsed = [&] () {
+        return chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+    };
+
+    vector<Dataset> shards(nb_threads);
+    parallel(nb_threads, [&] (int t) {
+        build_shard(in, in.size() * t / nb_threads, in.size() * (t+1) / nb_threads, shards[t]);
+    });
+    in = Input();
+    size_t n = 0;
+    for(const Dataset &d : shards) n += d.size();
+    printf("%zu quiet positions, %d threads, %.1fs\n", n, nb_threads, elapsed());
+    if(n == 0) return 1;
+    fflush(stdout);
+
+    EvalParams params = eval_params;
+    double *p = param_vector(params);
+    double k = fit_k(shards, p, n);
+
+    // Adam, one full batch step per epoch
+    vector<double> m(NB_EVAL_PARAMS, 0), v(NB_EVAL_PARAMS, 0);
+    vector<vector<double>> grads(nb_threads);
+    double factor = 2 * k * log(10) / 400 / n;
+    for(int epoch = 1; epoch <= epochs; ++epoch) {
+        double loss = total_loss(shards, p, k, &grads) / n;
+        for(int i = 0; i < NB_EVAL_PARAMS; ++i) {
+            double g = 0;
+            for(const vector<double> &grad : grads) g += grad[i];
+            g *= factor;
+            m[i] = ADAM_BETA1 * m[i] + (1 - ADAM_BETA1) * g;
+            v[i] = ADAM_BETA2 * v[i] + (1 - ADAM_BETA2) * g * g;
+            double m_hat = m[i] / (1 - pow(ADAM_BETA1, epoch));
+            double v_hat = v[i] / (1 - pow(ADAM_BETA2, epoch));
+            p[i] -= rate * m_hat / (sqrt(v_hat) + 1e-12);
+        }
+        if(epoch % 10 == 0 || epoch == epochs) {
+            printf("epoch %d loss %.6f %.1fs\n", epoch, loss, elapsed());
+            fflush(stdout);
+        }
+    }
+    printf("final loss %.6f\n", total_loss(shards, p, k, nullptr) / n);
+
+    // loadable with setoption name EvalFile, and paste-ready for board.cpp
+    FILE *f = fopen((out + ".txt").c_str(), "w");
+    FILE *g = fopen((out + ".inc").c_str(), "w");
+    if(f == nullptr || g == nullptr) {
+        perror(out.c_str());
+        return 1;
+    }
+    save_eval_params(params, f);
+    print_eval_params(params, g);
+    fclose(f);
+    fclose(g);
+    printf("wrote %s.txt and %s.inc\n", out.c_str(), out.c_str());
+    return 0;
+}
@@ -0,0 +1,8 @@
+#ifndef TUNE_HPP_
+#define TUNE_HPP_
+
+// SAkuna tune FILE... [threads N] [epochs N] [rate X] [out PREFIX]
+// FILE: EPD with game results, or .bin records written by datagen.
+int tune(int argc, char **argv);
+
+#endif
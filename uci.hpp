@@ -74,6 +74,10 @@ public:
   boost::signals2::signal<void()>                                                              receive_ponder_hit  ;
   boost::signals2::signal<void()>                                                              receive_quit        ;
 
+  // Engine extensions.
+  boost::signals2::signal<void(const std::string& fen, const std::vector<std::string>& moves, int depth)> receive_analyze_game;
+  boost::signals2::signal<void()>                                                              receive_stats       ;
+
   // Engine to UI.
   static void send_id                                (const std::string& name = "", const std::string& author = "")
   {
@@ -333,6 +337,35 @@ public:
             commands[command::infinite];
         receive_go(commands);
       }
+      else if (token == "analyzegame")
+      {
+        std::string              fen  ;
+        std::vector<std::string> moves;
+        auto                     depth = 6;
+        iss >> token;
+        if (token == "depth")
+        {
+          iss >> depth;
+          iss >> token;
+        }
+        if (token == "startpos")
+        {
+          fen = start_fen;
+          iss >> token;
+        }
+        else if (token == "fen")
+          while(iss >> token && token != "moves")
+            fen += token + " ";
+        else
+          continue;
+        while (iss >> token)
+          moves.push_back(token);
+        receive_analyze_game(fen, moves, depth);
+      }
+      else if (token == "stats"     )
+      {
+        receive_stats();
+      }
       else if (token == "stop"      )
       {
         receive_stop();